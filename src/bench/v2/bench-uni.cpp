@@ -0,0 +1,189 @@
+#include <uni/v2/uni.h>
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+/* Throughput measurements for encoding with Program_builder.
+ *
+ * Every workload is run with Byte_vector_allocator, which uses the
+ * contiguous code paths, and with Opaque_allocator, which provides the same
+ * memory through an iterator that is not detected as contiguous and hence
+ * uses the byte-wise code paths. */
+
+
+namespace {
+
+  /** Random-access iterator over bytes that hides the contiguity of the
+   * underlying memory. */
+  struct Opaque_iterator {
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef uni::Byte value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef uni::Byte* pointer;
+    typedef uni::Byte& reference;
+
+    uni::Byte* p = nullptr;
+
+    Opaque_iterator() {
+    }
+
+    explicit Opaque_iterator(uni::Byte* p)
+      : p(p) {
+    }
+
+    uni::Byte& operator * () const {
+      return *p;
+    }
+
+    Opaque_iterator& operator ++ () {
+      ++p;
+      return *this;
+    }
+
+    bool operator == (Opaque_iterator const& o) const {
+      return p == o.p;
+    }
+
+    bool operator != (Opaque_iterator const& o) const {
+      return p != o.p;
+    }
+
+    std::ptrdiff_t operator - (Opaque_iterator const& o) const {
+      return p - o.p;
+    }
+  };
+
+
+  struct Opaque_allocator {
+    static size_t const block_size =
+      uni::Byte_vector_allocator::default_block_size;
+    typedef std::vector<uni::Byte> Container;
+    typedef Opaque_iterator Iterator;
+
+    Iterator begin(Container& c) {
+      return Iterator(c.data());
+    }
+
+    Iterator end(Container& c) {
+      return Iterator(c.data() + c.size());
+    }
+
+    Container allocate(size_t capacity) {
+      return Container(capacity);
+    }
+  };
+
+
+  /** Best of several runs of f in seconds. */
+  template<typename F>
+  double measure(F f, int runs = 5) {
+    double best = 0.;
+    for(int i=0; i<runs; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      f();
+      std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+      if( (i == 0) || (d.count() < best) )
+        best = d.count();
+    }
+    return best;
+  }
+
+
+  void report(std::string const& name, std::size_t bytes, double seconds) {
+    std::cout << std::setw(40) << std::left << name
+      << std::setw(10) << std::right << std::fixed << std::setprecision(1)
+      << (bytes / seconds / 1e6) << " MB/s\n";
+  }
+
+
+  template<typename Allocator>
+  std::size_t encode_spiketrain(std::vector<uni::Spike> const& spikes) {
+    Allocator alloc;
+    uni::Program_builder<Allocator> bld(alloc);
+    bld.spiketrain(std::begin(spikes), std::end(spikes),
+        uni::Standard_address_map());
+    bld.halt();
+    return bld.containers.size() * alloc.block_size;
+  }
+
+
+  template<typename Allocator>
+  std::size_t encode_writes(std::size_t num, Allocator alloc = Allocator()) {
+    uni::Program_builder<Allocator> bld(alloc);
+    for(std::size_t i=0; i<num; ++i)
+      bld.write(i, i * 0x9e3779b9u);
+    bld.halt();
+    return bld.containers.size() * alloc.block_size;
+  }
+
+
+  /** Encode num writes into buf with the low-level fill functions. */
+  template<typename It>
+  It fill_writes(It it, std::size_t num) {
+    for(std::size_t i=0; i<num; ++i)
+      it = uni::fill_write(it, i, i * 0x9e3779b9u);
+    return it;
+  }
+
+}
+
+
+int main() {
+  using namespace uni;
+
+  std::size_t const num_spikes = 4000000;
+  std::size_t const num_writes = 4000000;
+
+  std::vector<Spike> spikes;
+  spikes.reserve(num_spikes);
+  Time spike_t = 1000;
+  for(std::size_t i=0; i<num_spikes; ++i) {
+    spike_t += (i % 3) ? 20 : 300;
+    spikes.emplace_back(spike_t, ((i % 32) << 8) | (i % 64));
+  }
+
+  std::size_t bytes = 0;
+  double t = 0.;
+
+  t = measure([&]{ bytes = encode_spiketrain<Opaque_allocator>(spikes); });
+  report("spiketrain (byte-wise)", bytes, t);
+  t = measure([&]{ bytes = encode_spiketrain<Byte_vector_allocator>(spikes); });
+  report("spiketrain (contiguous)", bytes, t);
+
+  t = measure([&]{ bytes = encode_writes<Opaque_allocator>(num_writes); });
+  report("write (byte-wise)", bytes, t);
+  t = measure([&]{ bytes = encode_writes<Byte_vector_allocator>(num_writes); });
+  report("write (contiguous)", bytes, t);
+  for(std::size_t block_size : { 16 << 10, 64 << 10, 1 << 20 }) {
+    t = measure([&]{
+        bytes = encode_writes(num_writes, Byte_vector_allocator(block_size));
+      });
+    report("write (contiguous, " + std::to_string(block_size >> 10)
+        + " KiB blocks)", bytes, t);
+  }
+
+  // cache-resident buffer to measure the encoding kernels only
+  std::vector<Byte> buf(9 * 4096);
+  std::size_t const reps = 1000;
+
+  t = measure([&]{
+      for(std::size_t i=0; i<reps; ++i)
+        fill_writes(Opaque_iterator(buf.data()), 4096);
+    });
+  report("fill_write (byte-wise)", reps * buf.size(), t);
+  t = measure([&]{
+      for(std::size_t i=0; i<reps; ++i)
+        fill_writes(buf.data(), 4096);
+    });
+  report("fill_write (contiguous)", reps * buf.size(), t);
+
+  return 0;
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
@@ -0,0 +1,662 @@
+#include <uni/v3/uni.h>
+#include <uni/v3/aligned_allocator.h>
+#include <uni/v3/arena_allocator.h>
+#include <uni/v3/block_pool_allocator.h>
+#include <uni/v3/mapped_file_allocator.h>
+#include <uni/v3/parallel_decode.h>
+#include <uni/v3/raw_extract_decoder.h>
+#include <uni/v3/raw_reshape_decoder.h>
+#include <uni/v3/rw_extract_decoder.h>
+#include <uni/v3/spiketrain_decoder.h>
+#include <uni/v3/time_index.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* Throughput measurements for decoding.
+ *
+ * Workloads are decoded from std::vector<Byte>, which uses the contiguous
+ * code paths, and through Opaque_iterator, which provides the same memory
+ * through an iterator that is not detected as contiguous and hence uses the
+ * byte-wise code paths. */
+
+
+namespace {
+
+  /** Random-access iterator over bytes that hides the contiguity of the
+   * underlying memory. */
+  struct Opaque_iterator {
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef uni::Byte value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef uni::Byte const* pointer;
+    typedef uni::Byte const& reference;
+
+    uni::Byte const* p = nullptr;
+
+    Opaque_iterator() {
+    }
+
+    explicit Opaque_iterator(uni::Byte const* p)
+      : p(p) {
+    }
+
+    uni::Byte const& operator * () const {
+      return *p;
+    }
+
+    Opaque_iterator& operator ++ () {
+      ++p;
+      return *this;
+    }
+
+    bool operator == (Opaque_iterator const& o) const {
+      return p == o.p;
+    }
+
+    bool operator != (Opaque_iterator const& o) const {
+      return p != o.p;
+    }
+
+    Opaque_iterator operator + (std::ptrdiff_t n) const {
+      return Opaque_iterator(p + n);
+    }
+
+    std::ptrdiff_t operator - (Opaque_iterator const& o) const {
+      return p - o.p;
+    }
+  };
+
+
+  /** Best of several runs of f in seconds. */
+  template<typename F>
+  double measure(F f, int runs = 5) {
+    double best = 0.;
+    for(int i=0; i<runs; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      f();
+      std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+      if( (i == 0) || (d.count() < best) )
+        best = d.count();
+    }
+    return best;
+  }
+
+
+  void report(std::string const& name, std::size_t bytes, double seconds) {
+    std::cout << std::setw(40) << std::left << name
+      << std::setw(10) << std::right << std::fixed << std::setprecision(1)
+      << (bytes / seconds / 1e6) << " MB/s\n";
+  }
+
+
+  template<typename It>
+  It fill_fire_one_or_madc(It it, uint8_t key, uint32_t payload) {
+    *it = 0x0f;
+    ++it;
+    it = uni::fill_data(it, (static_cast<uint64_t>(key) << 30) | payload);
+    *it = 0x00;
+    return ++it;
+  }
+
+
+  /** Synthetic recording of spikes and MADC samples with timing, register
+   * accesses and loopback data. */
+  std::vector<uni::Byte> make_recording(std::size_t size) {
+    using namespace uni;
+
+    std::vector<Byte> rv(size + 512);
+    std::mt19937 rng(1234);
+    std::vector<Byte> raw(16);
+
+    auto it = fill_set_time(rv.begin(), 0);
+    while( static_cast<std::size_t>(it - rv.begin()) < size ) {
+      unsigned const r = rng() % 100;
+      if( r < 35 )
+        it = fill_wait_for_7(it, rng() & 0x7f);
+      else if( r < 40 )
+        it = fill_wait_for_16(it, rng() & 0xffff);
+      else if( r < 60 )
+        it = fill_fire_one_or_madc(it, 0, rng() & 0xff);
+      else if( r < 90 )
+        it = fill_fire_one_or_madc(it, 3, rng() & 0x3fffffff);
+      else if( r < 95 )
+        it = fill_write(it, rng(), rng());
+      else if( r < 99 )
+        it = fill_read(it, rng());
+      else {
+        for(auto& b : raw)
+          b = rng();
+        it = fill_raw(it, raw);
+      }
+    }
+    it = fill_halt(it);
+    rv.resize(it - rv.begin());
+    return rv;
+  }
+
+
+  /** Synthetic MADC recording: runs of FIRE_ONE instructions with three
+   * samples each, separated by waits. */
+  std::vector<uni::Byte> make_madc(std::size_t size) {
+    using namespace uni;
+
+    std::vector<Byte> rv(size + 512);
+    std::mt19937 rng(1234);
+
+    auto it = fill_set_time(rv.begin(), 0);
+    while( static_cast<std::size_t>(it - rv.begin()) < size ) {
+      for(unsigned i=0; i<32; ++i)
+        it = fill_fire_one_or_madc(it, 3, rng() & 0x3fffffff);
+      it = fill_wait_for_7(it, 1);
+    }
+    it = fill_halt(it);
+    rv.resize(it - rv.begin());
+    return rv;
+  }
+
+
+  /** Synthetic idle recording: long runs of WAIT_FOR_7 with a few spikes. */
+  std::vector<uni::Byte> make_idle(std::size_t size) {
+    using namespace uni;
+
+    std::vector<Byte> rv(size + 512);
+    std::mt19937 rng(1234);
+
+    auto it = fill_set_time(rv.begin(), 0);
+    while( static_cast<std::size_t>(it - rv.begin()) < size ) {
+      unsigned const n = 64 + rng() % 256;
+      for(unsigned i=0; i<n; ++i)
+        it = fill_wait_for_7(it, rng() & 0x7f);
+      it = fill_fire_one_or_madc(it, 0, rng() & 0xff);
+    }
+    it = fill_halt(it);
+    rv.resize(it - rv.begin());
+    return rv;
+  }
+
+
+  /** Program built with Program_builder: writes with waits, concatenated
+   * blocks. */
+  std::vector<uni::Byte> make_program(std::size_t size) {
+    using namespace uni;
+
+    std::mt19937 rng(1234);
+    Byte_vector_allocator alloc;
+    Program_builder<Byte_vector_allocator> bld(alloc);
+
+    bld.set_time(0);
+    while( bld.containers.size() * alloc.block_size < size ) {
+      bld.wait_for(rng() % 0x1000);
+      bld.write(rng(), rng());
+    }
+    bld.halt();
+
+    std::vector<Byte> rv;
+    rv.reserve(size + Byte_vector_allocator::default_block_size);
+    for(auto const& c : bld.containers)
+      rv.insert(rv.end(), c.begin(), c.end());
+    return rv;
+  }
+
+
+  /** Vector for the blocks of a new program, recycled ones from a pool. */
+  template<typename Allocator>
+  std::vector<typename Allocator::Container> container_list(Allocator&) {
+    return std::vector<typename Allocator::Container>();
+  }
+
+  std::vector<uni::Block_pool_allocator::Container> container_list(
+      uni::Block_pool_allocator& pool) {
+    return pool.take_container_list();
+  }
+
+
+  /** Encode num_programs programs of about size bytes each with blocks from
+   * alloc and pass the blocks of every program to done. */
+  template<typename Allocator, typename Done>
+  void encode_programs(Allocator& alloc, std::size_t num_programs,
+      std::size_t size, Done done) {
+    for(std::size_t n=0; n<num_programs; ++n) {
+      uni::Program_builder<Allocator> bld(alloc, container_list(alloc));
+      bld.set_time(0);
+      for(uint32_t i=0; bld.containers.size() * alloc.block_size < size;
+          ++i) {
+        bld.wait_for(i & 0xfff);
+        bld.write(i, i);
+      }
+      bld.halt();
+      done(bld.containers);
+    }
+  }
+
+
+  /** Decode all blocks of a program. */
+  template<typename Decoder, typename Container>
+  void decode_blocks(std::vector<Container> const& containers) {
+    Decoder dec;
+    for(auto const& c : containers)
+      decode(c.data(), c.data() + c.size(), dec);
+  }
+
+
+  /** Synthetic loopback capture: RAW instructions of 255 bytes with runs of
+   * valid nibbles. */
+  std::vector<uni::Byte> make_loopback(std::size_t size) {
+    using namespace uni;
+
+    std::vector<Byte> rv(size + 512);
+    std::mt19937 rng(1234);
+    std::vector<Byte> raw(255);
+    bool valid = true;
+    unsigned run = 0;
+
+    auto it = fill_set_time(rv.begin(), 0);
+    while( static_cast<std::size_t>(it - rv.begin()) < size ) {
+      for(auto& b : raw) {
+        Byte v = rng() & 0xbb;
+        for(int k=0; k<2; ++k) {
+          if( run-- == 0 ) {
+            valid = !valid;
+            run = valid ? 66 : rng() % 8;
+          }
+          v |= valid ? (4 << (4 * k)) : 0;
+        }
+        b = v;
+      }
+      it = fill_raw(it, raw);
+      it = fill_wait_for_7(it, 1);
+    }
+    it = fill_halt(it);
+    rv.resize(it - rv.begin());
+    return rv;
+  }
+
+
+  /** Raw_extract_decoder and Raw_reshape_decoder as implemented before
+   * Nibble_packer, for comparison. */
+  struct Deque_raw_decoder {
+    bool reshape = false;
+    std::size_t num_nibbles = 33;
+    std::vector<uni::Raw_inst> extracted;
+    std::deque<uint8_t> nibbles;
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void append() {
+      uni::Raw_inst e;
+      for(std::size_t i=0; i<nibbles.size(); i += 2) {
+        uint8_t tmp = nibbles[i] << 4;
+        if( i+1 < nibbles.size() )
+          tmp |= nibbles[i+1];
+        e.data.push_back(tmp);
+      }
+      extracted.push_back(e);
+      nibbles.clear();
+    }
+
+    void push(uint8_t nibble, bool valid) {
+      if( reshape ) {
+        nibbles.push_front(nibble);
+        if( nibbles.size() >= num_nibbles )
+          append();
+      } else if( valid )
+        nibbles.push_front(nibble);
+      else if( !nibbles.empty() )
+        append();
+    }
+
+    void operator () (uni::Raw_inst const& inst) {
+      for(std::size_t i=0; i<inst.data.size(); ++i) {
+        auto idx = inst.data.size() - i - 1;
+        push(inst.data[idx] & 0xf, inst.data[idx] & (1 << 2));
+        if( idx != 0 )
+          push((inst.data[idx] >> 4) & 0xf, inst.data[idx] & (1 << 6));
+      }
+    }
+  };
+
+  struct Deque_raw_reshape_decoder : Deque_raw_decoder {
+    Deque_raw_reshape_decoder() {
+      reshape = true;
+    }
+  };
+
+
+  template<typename Decoder>
+  void bench_decode_contiguous(std::string const& name,
+      std::vector<uni::Byte> const& rec) {
+    double const t = measure([&]{
+        Decoder dec;
+        uni::decode(rec.begin(), rec.end(), dec);
+      });
+    report(name, rec.size(), t);
+  }
+
+
+  template<typename Decoder>
+  void bench_decode(std::string const& name, std::vector<uni::Byte> const& rec) {
+    double t = measure([&]{
+        Decoder dec;
+        uni::decode(Opaque_iterator(rec.data()),
+            Opaque_iterator(rec.data() + rec.size()), dec);
+      });
+    report(name + " (byte-wise)", rec.size(), t);
+
+    t = measure([&]{
+        Decoder dec;
+        uni::decode(rec.begin(), rec.end(), dec);
+      });
+    report(name + " (contiguous)", rec.size(), t);
+
+    t = measure([&]{
+        Decoder dec;
+        auto const v = uni::validate(rec.begin(), rec.end());
+        uni::decode_unchecked(rec.begin(), rec.begin() + v.end, dec);
+      });
+    report(name + " (validate + unchecked)", rec.size(), t);
+  }
+
+
+  /** Decoder that only counts the decoded instructions. */
+  struct Count_decoder {
+    std::size_t count = 0;
+
+    template<typename T> void operator () (T const& /*inst*/) {
+      ++count;
+    }
+  };
+
+}
+
+
+int main() {
+  using namespace uni;
+
+  std::vector<Byte> const rec = make_recording(64 << 20);
+
+  bench_decode<Count_decoder>("decode count", rec);
+  bench_decode<Standard_spiketrain_and_madc_decoder>("decode spiketrain", rec);
+  bench_decode<Rw_extract_decoder>("decode rw_extract", rec);
+  bench_decode<Compact_rw_extract_decoder>("decode compact rw_extract", rec);
+  bench_decode<Raw_extract_decoder>("decode raw_extract", rec);
+
+  bench_decode_contiguous<Standard_columnar_spiketrain_and_madc_decoder>(
+      "decode spiketrain columns", rec);
+  double t = measure([&]{
+      Standard_columnar_spiketrain_and_madc_decoder dec;
+      dec.reserve(count_spikes_and_samples(rec.begin(), rec.end()));
+      decode(rec.begin(), rec.end(), dec);
+    });
+  report("decode spiketrain columns (counted)", rec.size(), t);
+
+  // a window of 1/1000 of the recording, reported as throughput over the
+  // whole recording
+  Byte const* const rec_a = rec.data();
+  Byte const* const rec_b = rec_a + rec.size();
+  Time_index index;
+  t = measure([&]{
+      index = build_time_index(rec_a, rec_b, 64 << 10);
+    });
+  report("build_time_index", rec.size(), t);
+  t = measure([&]{
+      summarize_program(rec_a, rec_b);
+    });
+  report("summarize_program", rec.size(), t);
+  Time const duration = summarize_time(rec_a, rec_b).t;
+  t = measure([&]{
+      Standard_spiketrain_and_madc_decoder dec;
+      decode_window(rec_a, rec_b, index, duration / 2,
+          duration / 2 + duration / 1000, dec);
+    });
+  report("window spiketrain (decode_window)", rec.size(), t);
+
+  t = measure([&]{
+      Standard_spiketrain_and_madc_decoder spikes;
+      Rw_extract_decoder rw;
+      Raw_extract_decoder raw;
+      decode(rec.begin(), rec.end(), spikes);
+      decode(rec.begin(), rec.end(), rw);
+      decode(rec.begin(), rec.end(), raw);
+    });
+  report("spiketrain + rw + raw (3 passes)", 3 * rec.size(), t);
+  t = measure([&]{
+      Standard_spiketrain_and_madc_decoder spikes;
+      Rw_extract_decoder rw;
+      Raw_extract_decoder raw;
+      auto dec = fan_out(spikes, rw, raw);
+      decode(rec.begin(), rec.end(), dec);
+    });
+  report("spiketrain + rw + raw (fan_out)", 3 * rec.size(), t);
+
+  std::vector<Byte> const madc = make_madc(64 << 20);
+  bench_decode<Standard_spiketrain_and_madc_decoder>("madc spiketrain", madc);
+  bench_decode<Standard_columnar_spiketrain_and_madc_decoder>(
+      "madc spiketrain columns", madc);
+
+  std::vector<Byte> const idle = make_idle(64 << 20);
+  bench_decode<Standard_spiketrain_and_madc_decoder>("idle spiketrain", idle);
+
+  std::vector<Byte> const program = make_program(64 << 20);
+  Byte const* const program_a = program.data();
+  Byte const* const program_b = program_a + program.size();
+  t = measure([&]{
+      summarize_program(program_a, program_b);
+    });
+  report("program summarize_program", program.size(), t);
+  t = measure([&]{
+      Compact_rw_extract_decoder dec;
+      decode(program_a, program_b, dec);
+    });
+  report("program rw_extract (decode)", program.size(), t);
+  t = measure([&]{
+      auto const splits = block_split_points(program_a, program_b,
+          Byte_vector_allocator::default_block_size);
+      parallel_decode<Compact_rw_extract_decoder>(program_a, program_b, splits);
+    });
+  report("program rw_extract (parallel_decode, "
+      + std::to_string(std::thread::hardware_concurrency()) + " cores)",
+      program.size(), t);
+
+  std::vector<std::vector<Byte>> programs;
+  std::size_t programs_size = 0;
+  for(std::size_t i=0; programs_size < (64u << 20); ++i) {
+    programs.push_back(make_program((i % 8 == 0) ? (4 << 20) : (256 << 10)));
+    programs_size += programs.back().size();
+  }
+  t = measure([&]{
+      for(auto const& p : programs) {
+        Compact_rw_extract_decoder dec;
+        decode(p.data(), p.data() + p.size(), dec);
+      }
+    });
+  report("programs rw_extract (decode)", programs_size, t);
+  t = measure([&]{
+      batch_decode(programs.begin(), programs.end(),
+          []{ return Compact_rw_extract_decoder(); });
+    });
+  report("programs rw_extract (batch_decode, "
+      + std::to_string(std::thread::hardware_concurrency()) + " cores)",
+      programs_size, t);
+
+  // small batches decoded over and over, where starting threads counts
+  std::vector<std::vector<Byte>> small_programs;
+  for(std::size_t i=0; i<16; ++i)
+    small_programs.push_back(make_program(16 << 10));
+  std::size_t const small_size = 16 * small_programs[0].size();
+  std::size_t const small_runs = 1000;
+  // keeps the otherwise unused results from being optimized away
+  std::size_t volatile accesses = 0;
+  t = measure([&]{
+      for(std::size_t k=0; k<small_runs; ++k)
+        for(auto const& p : small_programs) {
+          Compact_rw_extract_decoder dec;
+          decode(p.data(), p.data() + p.size(), dec);
+          accesses = accesses + dec.extracted.size();
+        }
+    });
+  report("small programs rw_extract (decode)", small_runs * small_size, t);
+  t = measure([&]{
+      for(std::size_t k=0; k<small_runs; ++k)
+        batch_decode(small_programs.begin(), small_programs.end(),
+            []{ return Compact_rw_extract_decoder(); }, 4);
+    });
+  report("small programs (batch_decode, 4 threads)", small_runs * small_size,
+      t);
+  Worker_pool workers(4);
+  t = measure([&]{
+      for(std::size_t k=0; k<small_runs; ++k)
+        batch_decode(small_programs.begin(), small_programs.end(),
+            []{ return Compact_rw_extract_decoder(); }, workers);
+    });
+  report("small programs (Worker_pool, 4 threads)", small_runs * small_size,
+      t);
+
+  std::vector<Byte> const loopback = make_loopback(16 << 20);
+  bench_decode_contiguous<Deque_raw_decoder>("loopback raw_extract (deque)",
+      loopback);
+  bench_decode_contiguous<Raw_extract_decoder>("loopback raw_extract", loopback);
+  bench_decode_contiguous<Deque_raw_reshape_decoder>(
+      "loopback raw_reshape (deque)", loopback);
+  bench_decode_contiguous<Raw_reshape_decoder>("loopback raw_reshape",
+      loopback);
+
+  std::size_t const num_programs = 256;
+  std::size_t const program_size = 256 << 10;
+  t = measure([&]{
+      Byte_vector_allocator alloc;
+      encode_programs(alloc, num_programs, program_size,
+          [](std::vector<Byte_vector_allocator::Container>&) {});
+    });
+  report("encode (Byte_vector_allocator)", num_programs * program_size, t);
+  Block_pool_allocator pool;
+  t = measure([&]{
+      encode_programs(pool, num_programs, program_size,
+          [&pool](std::vector<Block_pool_allocator::Container>& c) {
+            pool.recycle(std::move(c));
+          });
+    });
+  report("encode (Block_pool_allocator)", num_programs * program_size, t);
+
+  // programs that have to be contiguous for transfer
+  std::vector<Byte> gathered;
+  t = measure([&]{
+      Byte_vector_allocator alloc;
+      encode_programs(alloc, num_programs, program_size,
+          [&gathered](std::vector<Byte_vector_allocator::Container>& c) {
+            gathered.clear();
+            for(auto const& block : c)
+              gathered.insert(gathered.end(), block.begin(), block.end());
+          });
+    });
+  report("encode + gather (Byte_vector_allocator)",
+      num_programs * program_size, t);
+  Arena_allocator arena(2 * program_size);
+  t = measure([&]{
+      encode_programs(arena, num_programs, program_size,
+          [&arena](std::vector<Arena_allocator::Container>&) {
+            arena.reset();
+          });
+    });
+  report("encode contiguous (Arena_allocator)", num_programs * program_size,
+      t);
+
+  // a large program for DMA transfer, which needs page-aligned memory: the
+  // blocks of Byte_vector_allocator are copied to a staging buffer, those
+  // of Aligned_allocator are transferred as they are
+  std::size_t const dma_size = 64 << 20;
+  Aligned_allocator staging_alloc(dma_size + (4 << 20));
+  Aligned_block staging = staging_alloc.allocate(staging_alloc.block_size);
+  t = measure([&]{
+      Byte_vector_allocator alloc;
+      encode_programs(alloc, 1, dma_size,
+          [&staging](std::vector<Byte_vector_allocator::Container>& c) {
+            Byte* p = staging.data();
+            for(auto const& block : c) {
+              std::memcpy(p, block.data(), block.size());
+              p += block.size();
+            }
+          });
+    });
+  report("encode + stage (Byte_vector_allocator)", dma_size, t);
+
+  struct Aligned_config {
+    char const* name;
+    std::size_t block_size;
+    Huge_pages huge_pages;
+  };
+  Aligned_config const aligned_configs[] = {
+    { "encode (Aligned_allocator, 4 KiB)", 4 << 10, Huge_pages::none },
+    { "encode (Aligned_allocator, 2 MiB)", 2 << 20, Huge_pages::none },
+    { "encode (Aligned_allocator, 2 MiB huge)", 2 << 20,
+      Huge_pages::transparent },
+  };
+  for(auto const& config : aligned_configs) {
+    t = measure([&]{
+        Aligned_allocator alloc(config.block_size, config.huge_pages);
+        encode_programs(alloc, 1, dma_size,
+            [](std::vector<Aligned_allocator::Container>&) {});
+      });
+    report(config.name, dma_size, t);
+  }
+
+  {
+    Byte_vector_allocator alloc;
+    Program_builder<Byte_vector_allocator> bld(alloc);
+    encode_programs(alloc, 1, dma_size,
+        [&bld](std::vector<Byte_vector_allocator::Container>& c) {
+          bld.containers.swap(c);
+        });
+    t = measure([&]{
+        decode_blocks<Compact_rw_extract_decoder>(bld.containers);
+      });
+    report("blocks rw_extract (4 KiB vectors)", dma_size, t);
+  }
+  {
+    Aligned_allocator alloc(2 << 20, Huge_pages::transparent);
+    Program_builder<Aligned_allocator> bld(alloc);
+    encode_programs(alloc, 1, dma_size,
+        [&bld](std::vector<Aligned_allocator::Container>& c) {
+          bld.containers.swap(c);
+        });
+    t = measure([&]{
+        decode_blocks<Compact_rw_extract_decoder>(bld.containers);
+      });
+    report("blocks rw_extract (2 MiB huge pages)", dma_size, t);
+  }
+
+  // one large program streamed to a file and decoded from it
+  std::string const path = "/tmp/bench-uni-program";
+  t = measure([&]{
+      Mapped_file_allocator file(path);
+      encode_programs(file, 1, num_programs * program_size,
+          [](std::vector<Mapped_file_allocator::Container>&) {});
+    });
+  report("encode to file (Mapped_file_allocator)",
+      num_programs * program_size, t);
+  {
+    Mapped_program mapped(path);
+    t = measure([&]{
+        Compact_rw_extract_decoder dec;
+        decode(mapped.begin(), mapped.end(), dec);
+      });
+    report("file rw_extract (Mapped_program)", mapped.size(), t);
+  }
+  std::remove(path.c_str());
+
+  return 0;
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
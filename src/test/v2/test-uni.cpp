@@ -3,8 +3,11 @@
 #include <uni/v2/spiketrain_decoder.h>
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <array>
+#include <list>
 
 
 //TEST(uni, general_usage) {
@@ -62,6 +65,83 @@ TEST(uni, instruction_generation) {
 
 
 
+TEST(uni, contiguous_instruction_generation) {
+  using namespace uni;
+
+  std::vector<Byte> const expected {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09,
+    0x0a, 0x01, 0x02, 0x03, 0x04, 0xde, 0xad, 0xfa, 0xce,
+    0x04, 0xfe, 0xef,
+    0x05, 0xde, 0xad, 0xfa, 0xce,
+    0x0e
+  };
+
+  std::vector<Byte> bytes(expected.size());
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x01020304, 0xdeadface);
+  it = fill_wait_for_16(it, 0xfeef);
+  it = fill_wait_for_32(it, 0xdeadface);
+  it = fill_halt(it);
+  EXPECT_EQ(bytes.end(), it);
+  EXPECT_EQ(expected, bytes);
+
+  Byte raw[27];
+  Byte* p = fill_set_time(raw, 9);
+  p = fill_write(p, 0x01020304, 0xdeadface);
+  p = fill_wait_for_16(p, 0xfeef);
+  p = fill_wait_for_32(p, 0xdeadface);
+  p = fill_halt(p);
+  EXPECT_EQ(raw + sizeof(raw), p);
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), raw));
+}
+
+
+TEST(uni, integer_data) {
+  using namespace uni;
+
+  // any integer type is encoded by its size, not only the fixed-width ones
+  std::vector<Byte> const expected {
+    0x00, 0x00, 0x00, 0x05,
+    0xff, 0xfe,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+  };
+
+  std::vector<Byte> bytes(expected.size());
+  auto it = fill_data(bytes.begin(), 5);
+  it = fill_data(it, static_cast<short>(-2));
+  it = fill_data(it, 0x0102030405060708ull);
+  EXPECT_EQ(bytes.end(), it);
+  EXPECT_EQ(expected, bytes);
+
+  std::list<Byte> list(expected.size());
+  auto list_it = fill_data(list.begin(), 5);
+  list_it = fill_data(list_it, static_cast<short>(-2));
+  list_it = fill_data(list_it, 0x0102030405060708ull);
+  EXPECT_EQ(list.end(), list_it);
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), list.begin()));
+
+  int i = 0;
+  short s = 0;
+  unsigned long long ull = 0;
+  auto read_it = read_data(expected.begin(), i);
+  read_it = read_data(read_it, s);
+  read_it = read_data(read_it, ull);
+  EXPECT_EQ(expected.end(), read_it);
+  EXPECT_EQ(5, i);
+  EXPECT_EQ(-2, s);
+  EXPECT_EQ(0x0102030405060708ull, ull);
+
+  i = s = ull = 0;
+  auto list_read_it = read_data(list.cbegin(), i);
+  list_read_it = read_data(list_read_it, s);
+  list_read_it = read_data(list_read_it, ull);
+  EXPECT_EQ(list.cend(), list_read_it);
+  EXPECT_EQ(5, i);
+  EXPECT_EQ(-2, s);
+  EXPECT_EQ(0x0102030405060708ull, ull);
+}
+
+
 TEST(uni, instruction_decoding) {
   using namespace uni;
 
@@ -130,6 +210,21 @@ TEST(uni, instruction_decoding_3) {
 }
 
 
+TEST(uni, instruction_printing) {
+  using namespace uni;
+
+  Wait_for_7_inst inst;
+  inst.t = 17;
+
+  std::stringstream strm;
+  strm << inst;
+
+  EXPECT_EQ("     wait_for_7 17", strm.str());
+  EXPECT_STREQ("write", Write_inst().name());
+  EXPECT_EQ(Inst_id::read, Read_inst().id);
+}
+
+
 TEST(uni, raw_encode_decode) {
   using namespace uni;
 
@@ -214,6 +309,180 @@ TEST(uni, program_builder) {
 }
 
 
+namespace {
+
+  /** Allocator with non-random-access iterators to exercise the generic
+   * capacity checks of Program_builder. */
+  struct Byte_list_allocator {
+    static size_t const block_size = 4096;
+    typedef std::list<uni::Byte> Container;
+    typedef std::list<uni::Byte>::iterator Iterator;
+
+    Iterator begin(Container& c) {
+      return std::begin(c);
+    }
+
+    Iterator end(Container& c) {
+      return std::end(c);
+    }
+
+    Container allocate(size_t capacity) {
+      return Container(capacity);
+    }
+  };
+
+
+  template<typename Allocator>
+  void fill_exactly_one_block(uni::Program_builder<Allocator>& bld) {
+    // 455 writes of 9 bytes and one wait_for_7 fill 4096 bytes
+    for(int i=0; i<455; ++i)
+      bld.write(i, 0xdeadface);
+    bld.wait_for(1);
+  }
+
+}
+
+
+TEST(uni, program_builder_block_boundary) {
+  using namespace uni;
+
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> bld(alloc);
+
+  fill_exactly_one_block(bld);
+  ASSERT_EQ(1, bld.containers.size());
+
+  bld.write(455, 0xdeadface);
+  bld.halt();
+  ASSERT_EQ(2, bld.containers.size());
+
+  Rw_extract_decoder rws;
+  for(auto const& c : bld.containers)
+    decode(std::begin(c), std::end(c), rws);
+
+  ASSERT_EQ(456, rws.extracted.size());
+  for(size_t i=0; i<rws.extracted.size(); ++i)
+    EXPECT_EQ(i, rws.extracted[i].write.address);
+
+
+  Byte_list_allocator list_alloc;
+  Program_builder<Byte_list_allocator> list_bld(list_alloc);
+
+  fill_exactly_one_block(list_bld);
+  ASSERT_EQ(1, list_bld.containers.size());
+
+  list_bld.write(455, 0xdeadface);
+  list_bld.halt();
+  ASSERT_EQ(2, list_bld.containers.size());
+
+  for(size_t i=0; i<bld.containers.size(); ++i) {
+    EXPECT_TRUE(std::equal(std::begin(bld.containers[i]),
+          std::end(bld.containers[i]),
+          std::begin(list_bld.containers[i])));
+  }
+}
+
+
+namespace {
+
+  /** Allocator that runs out of memory after num_blocks blocks. */
+  struct Limited_allocator : uni::Byte_vector_allocator {
+    std::size_t num_blocks;
+
+    explicit Limited_allocator(std::size_t num_blocks)
+      : num_blocks(num_blocks) {
+    }
+
+    Container allocate(size_t capacity) {
+      if( num_blocks == 0 )
+        throw std::bad_alloc();
+      --num_blocks;
+      return Byte_vector_allocator::allocate(capacity);
+    }
+  };
+
+}
+
+
+TEST(uni, program_builder_failed_allocation) {
+  using namespace uni;
+
+  Limited_allocator alloc(1);
+  Program_builder<Limited_allocator> bld(alloc);
+
+  // 454 writes of 9 bytes and 5 wait_for_7 leave 5 bytes in the block
+  for(int i=0; i<454; ++i)
+    bld.write(i, 0xdeadface);
+  for(int i=0; i<5; ++i)
+    bld.wait_for(0);
+
+  // the block is padded before the failed allocation, so a smaller
+  // instruction must not be written into the padding afterwards
+  EXPECT_THROW(bld.write(454, 0xdeadface), std::bad_alloc);
+  EXPECT_THROW(bld.halt(), std::bad_alloc);
+  ASSERT_EQ(1, bld.containers.size());
+  auto const c = bld.containers[0];
+  EXPECT_TRUE(std::all_of(c.end() - 5, c.end(),
+        [](Byte b) { return b == 0x80; }));
+
+  alloc.num_blocks = 1;
+  bld.halt();
+  ASSERT_EQ(2, bld.containers.size());
+  EXPECT_EQ(0x0e, bld.containers[1][0]);
+
+  Rw_extract_decoder rws;
+  decode(std::begin(c), std::end(c), rws);
+  EXPECT_EQ(454, rws.extracted.size());
+}
+
+TEST(uni, program_builder_block_size) {
+  using namespace uni;
+
+  // 1820 writes of 9 bytes and 4 bytes of padding per block
+  std::size_t const block_size = 16 << 10;
+  Byte_vector_allocator alloc(block_size);
+  Program_builder<Byte_vector_allocator> bld(alloc);
+  for(int i=0; i<5000; ++i)
+    bld.write(i, 0xdeadface);
+  bld.halt();
+  ASSERT_EQ(3, bld.containers.size());
+
+  Rw_extract_decoder rws;
+  for(auto const& c : bld.containers) {
+    EXPECT_EQ(block_size, c.size());
+    decode(std::begin(c), std::end(c), rws);
+  }
+  ASSERT_EQ(5000, rws.extracted.size());
+
+  for(std::size_t i=0; i<2; ++i) {
+    auto const& c = bld.containers[i];
+    EXPECT_TRUE(std::all_of(c.end() - 4, c.end(),
+          [](Byte b) { return b == 0x80; }));
+    EXPECT_EQ(0x0a, *(c.end() - 4 - 9));
+  }
+
+  // blocks have to take the largest instruction
+  EXPECT_THROW(Byte_vector_allocator(8), std::invalid_argument);
+
+  Byte_vector_allocator changed;
+  changed.block_size = 8;
+  EXPECT_THROW(Program_builder<Byte_vector_allocator> too_small(changed),
+      std::invalid_argument);
+
+  Byte_vector_allocator smallest(detail::max_builder_inst_size());
+  Program_builder<Byte_vector_allocator> small_bld(smallest);
+  for(int i=0; i<10; ++i)
+    small_bld.write(i, 0xdeadface);
+  small_bld.halt();
+  EXPECT_LE(10, small_bld.containers.size());
+
+  Rw_extract_decoder small_rws;
+  for(auto const& c : small_bld.containers)
+    decode(std::begin(c), std::end(c), small_rws);
+  EXPECT_EQ(10, small_rws.extracted.size());
+}
+
+
 TEST(uni, fire_coding) {
   using namespace uni;
 
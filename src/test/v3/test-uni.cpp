@@ -1,10 +1,24 @@
 #include <uni/v3/uni.h>
+#include <uni/v3/aligned_allocator.h>
+#include <uni/v3/arena_allocator.h>
+#include <uni/v3/block_pool_allocator.h>
+#include <uni/v3/mapped_file_allocator.h>
+#include <uni/v3/parallel_decode.h>
+#include <uni/v3/raw_extract_decoder.h>
+#include <uni/v3/raw_reshape_decoder.h>
+#include <uni/v3/time_index.h>
 #include <uni/v3/rw_extract_decoder.h>
 #include <uni/v3/spiketrain_decoder.h>
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <array>
+#include <deque>
+#include <list>
+#include <random>
+#include <thread>
 
 
 //TEST(uni, general_usage) {
@@ -62,6 +76,83 @@ TEST(uni, instruction_generation) {
 
 
 
+TEST(uni, contiguous_instruction_generation) {
+  using namespace uni;
+
+  std::vector<Byte> const expected {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09,
+    0x0a, 0x01, 0x02, 0x03, 0x04, 0xde, 0xad, 0xfa, 0xce,
+    0x04, 0xfe, 0xef,
+    0x05, 0xde, 0xad, 0xfa, 0xce,
+    0x0e
+  };
+
+  std::vector<Byte> bytes(expected.size());
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x01020304, 0xdeadface);
+  it = fill_wait_for_16(it, 0xfeef);
+  it = fill_wait_for_32(it, 0xdeadface);
+  it = fill_halt(it);
+  EXPECT_EQ(bytes.end(), it);
+  EXPECT_EQ(expected, bytes);
+
+  Byte raw[27];
+  Byte* p = fill_set_time(raw, 9);
+  p = fill_write(p, 0x01020304, 0xdeadface);
+  p = fill_wait_for_16(p, 0xfeef);
+  p = fill_wait_for_32(p, 0xdeadface);
+  p = fill_halt(p);
+  EXPECT_EQ(raw + sizeof(raw), p);
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), raw));
+}
+
+
+TEST(uni, integer_data) {
+  using namespace uni;
+
+  // any integer type is encoded by its size, not only the fixed-width ones
+  std::vector<Byte> const expected {
+    0x00, 0x00, 0x00, 0x05,
+    0xff, 0xfe,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+  };
+
+  std::vector<Byte> bytes(expected.size());
+  auto it = fill_data(bytes.begin(), 5);
+  it = fill_data(it, static_cast<short>(-2));
+  it = fill_data(it, 0x0102030405060708ull);
+  EXPECT_EQ(bytes.end(), it);
+  EXPECT_EQ(expected, bytes);
+
+  std::list<Byte> list(expected.size());
+  auto list_it = fill_data(list.begin(), 5);
+  list_it = fill_data(list_it, static_cast<short>(-2));
+  list_it = fill_data(list_it, 0x0102030405060708ull);
+  EXPECT_EQ(list.end(), list_it);
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), list.begin()));
+
+  int i = 0;
+  short s = 0;
+  unsigned long long ull = 0;
+  auto read_it = read_data(expected.begin(), i);
+  read_it = read_data(read_it, s);
+  read_it = read_data(read_it, ull);
+  EXPECT_EQ(expected.end(), read_it);
+  EXPECT_EQ(5, i);
+  EXPECT_EQ(-2, s);
+  EXPECT_EQ(0x0102030405060708ull, ull);
+
+  i = s = ull = 0;
+  auto list_read_it = read_data(list.cbegin(), i);
+  list_read_it = read_data(list_read_it, s);
+  list_read_it = read_data(list_read_it, ull);
+  EXPECT_EQ(list.cend(), list_read_it);
+  EXPECT_EQ(5, i);
+  EXPECT_EQ(-2, s);
+  EXPECT_EQ(0x0102030405060708ull, ull);
+}
+
+
 TEST(uni, instruction_decoding) {
   using namespace uni;
 
@@ -130,6 +221,21 @@ TEST(uni, instruction_decoding_3) {
 }
 
 
+TEST(uni, instruction_printing) {
+  using namespace uni;
+
+  Wait_for_7_inst inst;
+  inst.t = 17;
+
+  std::stringstream strm;
+  strm << inst;
+
+  EXPECT_EQ("     wait_for_7 17", strm.str());
+  EXPECT_STREQ("write", Write_inst().name());
+  EXPECT_EQ(Inst_id::read, Read_inst().id);
+}
+
+
 TEST(uni, raw_encode_decode) {
   using namespace uni;
 
@@ -156,6 +262,314 @@ TEST(uni, raw_encode_decode) {
 }
 
 
+TEST(uni, contiguous_decoding) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(64);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_wait_until(it, 0x1000);
+  it = fill_write(it, 0x01020304, 0xdeadface);
+  it = fill_read(it, 0xcafe);
+  it = fill_raw(it, std::vector<Byte>{0x01, 0x02, 0x03});
+  it = fill_wait_for_7(it, 113);
+  it = fill_wait_for_16(it, 0xfeef);
+  it = fill_wait_for_32(it, 0xdeadface);
+  *it++ = 0x0f;
+  it = fill_data(it, uint64_t(0xc0000000 | (1 << 20) | (2 << 10) | 3));
+  *it++ = 0x00;
+  it = fill_halt(it);
+
+  std::stringstream contiguous;
+  Stream_decoder contiguous_printer(contiguous);
+  auto stop = decode(bytes.cbegin(), bytes.cend(), contiguous_printer);
+  EXPECT_EQ(it - bytes.begin(), stop - bytes.cbegin());
+
+  std::stringstream pointer;
+  Stream_decoder pointer_printer(pointer);
+  Byte const* const data = bytes.data();
+  Byte const* p = decode(data, data + bytes.size(), pointer_printer);
+  EXPECT_EQ(it - bytes.begin(), p - data);
+
+  std::list<Byte> list(bytes.begin(), bytes.end());
+  std::stringstream generic;
+  Stream_decoder generic_printer(generic);
+  decode(list.begin(), list.end(), generic_printer);
+
+  EXPECT_EQ(generic.str(), contiguous.str());
+  EXPECT_EQ(generic.str(), pointer.str());
+  EXPECT_NE(std::string::npos, contiguous.str().find("[01020304] = 0xdeadface"));
+}
+
+
+namespace {
+
+  /** Collects the RAW instructions it is passed as views. */
+  struct Raw_view_decoder {
+    static bool const raw_view = true;
+
+    std::vector<uni::Raw_view> views;
+    std::size_t copies = 0;
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void operator () (uni::Raw_view const& inst) {
+      views.push_back(inst);
+    }
+
+    void operator () (uni::Raw_inst const& /*inst*/) {
+      ++copies;
+    }
+  };
+
+}
+
+
+TEST(uni, raw_view_decoding) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(64);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_raw(it, std::vector<Byte>{0x44, 0x45, 0x04});
+  it = fill_wait_for_7(it, 3);
+  it = fill_raw(it, std::vector<Byte>{});
+  it = fill_raw(it, std::vector<Byte>{0x4f, 0x07, 0x00, 0x41});
+  it = fill_halt(it);
+
+  Raw_view_decoder dec;
+  decode(bytes.cbegin(), bytes.cend(), dec);
+  ASSERT_EQ(3, dec.views.size());
+  EXPECT_EQ(0, dec.copies);
+  EXPECT_EQ(bytes.data() + 1 + sizeof(Time) + 2, dec.views[0].data);
+  EXPECT_EQ(3, dec.views[0].size);
+  EXPECT_EQ(0, dec.views[1].size);
+  EXPECT_EQ(4, dec.views[2].size);
+  EXPECT_EQ(0x41, dec.views[2].end()[-1]);
+
+  // non-contiguous buffers still deliver copies
+  std::list<Byte> list(bytes.begin(), bytes.end());
+  Raw_view_decoder list_dec;
+  decode(list.begin(), list.end(), list_dec);
+  EXPECT_EQ(0, list_dec.views.size());
+  EXPECT_EQ(3, list_dec.copies);
+
+  // extraction gives the same result from views and copies
+  Raw_extract_decoder view_extract;
+  decode(bytes.cbegin(), bytes.cend(), view_extract);
+  Raw_extract_decoder list_extract;
+  decode(list.begin(), list.end(), list_extract);
+  ASSERT_EQ(list_extract.extracted.size(), view_extract.extracted.size());
+  EXPECT_FALSE(view_extract.extracted.empty());
+  for(std::size_t i=0; i<view_extract.extracted.size(); ++i)
+    EXPECT_EQ(list_extract.extracted[i], view_extract.extracted[i]);
+}
+
+
+namespace {
+
+  /** Nibble assembly of Raw_extract_decoder and Raw_reshape_decoder as
+   * originally implemented with a deque. */
+  struct Reference_raw_decoder {
+    bool reshape;
+    size_t num_nibbles = 33;
+    std::vector<uni::Raw_inst> extracted;
+    std::deque<uint8_t> nibbles;
+
+    explicit Reference_raw_decoder(bool reshape)
+      : reshape(reshape) {
+    }
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void append() {
+      uni::Raw_inst e;
+      for(size_t i=0; i<nibbles.size(); i += 2) {
+        uint8_t tmp = nibbles[i] << 4;
+        if( i+1 < nibbles.size() )
+          tmp |= nibbles[i+1];
+        e.data.push_back(tmp);
+      }
+      extracted.push_back(e);
+      nibbles.clear();
+    }
+
+    void push(uint8_t nibble, bool valid) {
+      if( reshape ) {
+        nibbles.push_front(nibble);
+        if( nibbles.size() >= num_nibbles )
+          append();
+      } else if( valid )
+        nibbles.push_front(nibble);
+      else if( !nibbles.empty() )
+        append();
+    }
+
+    void operator () (uni::Raw_inst const& inst) {
+      for(size_t i=0; i<inst.data.size(); ++i) {
+        auto idx = inst.data.size() - i - 1;
+        push(inst.data[idx] & 0xf, inst.data[idx] & (1 << 2));
+        if( idx != 0 )
+          push((inst.data[idx] >> 4) & 0xf, inst.data[idx] & (1 << 6));
+      }
+    }
+  };
+
+}
+
+
+TEST(uni, raw_extract_matches_reference) {
+  using namespace uni;
+
+  // runs of valid and invalid nibbles of random length
+  std::mt19937 rng(42);
+  std::vector<Byte> bytes(64 * 1024);
+  auto it = bytes.begin();
+  bool valid = true;
+  unsigned run = 0;
+  while( bytes.end() - it > 300 ) {
+    std::vector<Byte> data(rng() % 256);
+    for(auto& b : data) {
+      Byte v = rng() & 0xbb;
+      for(int k=0; k<2; ++k) {
+        if( run-- == 0 ) {
+          valid = !valid;
+          run = rng() % (valid ? 80 : 20);
+        }
+        v |= valid ? (4 << (4 * k)) : 0;
+      }
+      b = v;
+    }
+    it = fill_raw(it, data);
+    it = fill_wait_for_7(it, 1);
+  }
+  it = fill_halt(it);
+
+  Reference_raw_decoder ref_extract(false);
+  decode(bytes.cbegin(), bytes.cend(), ref_extract);
+  Raw_extract_decoder extract;
+  decode(bytes.cbegin(), bytes.cend(), extract);
+  ASSERT_LT(100, ref_extract.extracted.size());
+  ASSERT_EQ(ref_extract.extracted.size(), extract.extracted.size());
+  for(std::size_t i=0; i<extract.extracted.size(); ++i)
+    ASSERT_EQ(ref_extract.extracted[i], extract.extracted[i]) << i;
+
+  Reference_raw_decoder ref_reshape(true);
+  decode(bytes.cbegin(), bytes.cend(), ref_reshape);
+  Raw_reshape_decoder reshape;
+  decode(bytes.cbegin(), bytes.cend(), reshape);
+  ASSERT_LT(100, ref_reshape.extracted.size());
+  ASSERT_EQ(ref_reshape.extracted.size(), reshape.extracted.size());
+  for(std::size_t i=0; i<reshape.extracted.size(); ++i)
+    ASSERT_EQ(ref_reshape.extracted[i], reshape.extracted[i]) << i;
+  EXPECT_EQ(ref_reshape.nibbles.size(), reshape.nibbles.size());
+}
+
+
+TEST(uni, opcode_table) {
+  using namespace uni;
+
+  for(unsigned b=0x80; b<0x100; ++b) {
+    EXPECT_TRUE(opcode_info(b).valid);
+    EXPECT_EQ(Inst_id::wait_for_7, opcode_info(b).id);
+    EXPECT_EQ(1, opcode_info(b).size);
+  }
+
+  EXPECT_FALSE(opcode_info(0x03).valid);
+  EXPECT_FALSE(opcode_info(0x40).valid);
+  EXPECT_EQ(Inst_id::read, opcode_info(0x0b).id);
+  EXPECT_EQ(5, opcode_info(0x0b).size);
+  EXPECT_EQ(10, opcode_info(0x0f).size);
+  EXPECT_TRUE(opcode_info(0x02).size == Opcode_info::variable_size);
+  EXPECT_EQ(0x0e, inst_opcode(Inst_id::halt));
+
+  std::vector<Byte> bytes { 0x81, 0x03, 0x0e };
+  Stream_decoder printer(std::cout);
+  EXPECT_THROW(decode(bytes.begin(), bytes.end(), printer), Decode_error);
+}
+
+
+TEST(uni, validate_and_decode_unchecked) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(64);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x01020304, 0xdeadface);
+  it = fill_raw(it, std::vector<Byte>{0x01, 0x02, 0x03});
+  it = fill_wait_for_7(it, 113);
+  it = fill_read(it, 0xcafe);
+  auto const read_end = it;
+  it = fill_halt(it);
+
+  Validation v = validate(bytes.begin(), bytes.end());
+  EXPECT_EQ(it - bytes.begin(), v.end);
+  EXPECT_EQ(6, v.count);
+  EXPECT_TRUE(v.halted);
+  EXPECT_FALSE(v.bad_opcode);
+
+  std::stringstream checked, unchecked;
+  Stream_decoder checked_printer(checked), unchecked_printer(unchecked);
+  decode(bytes.begin(), bytes.end(), checked_printer);
+  auto stop = decode_unchecked(bytes.begin(), bytes.begin() + v.end,
+      unchecked_printer);
+  EXPECT_EQ(it, stop);
+  EXPECT_EQ(checked.str(), unchecked.str());
+
+  // READ cut off by the end of the buffer
+  v = validate(bytes.begin(), read_end - 1);
+  EXPECT_EQ(read_end - bytes.begin() - 5, v.end);
+  EXPECT_EQ(4, v.count);
+  EXPECT_FALSE(v.halted);
+  EXPECT_FALSE(v.bad_opcode);
+
+  // unknown opcode
+  *(read_end - 5) = 0x03;
+  v = validate(bytes.begin(), bytes.end());
+  EXPECT_EQ(read_end - bytes.begin() - 5, v.end);
+  EXPECT_TRUE(v.bad_opcode);
+}
+
+
+TEST(uni, stream_decode_context) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(2048);
+  auto it = fill_set_time(bytes.begin(), 9);
+  for(int i=0; i<20; ++i) {
+    it = fill_write(it, i, 0xdeadface);
+    it = fill_raw(it, std::vector<Byte>(i * 5, i));
+    it = fill_wait_for_7(it, i);
+    it = fill_wait_for_32(it, 0x10000 + i);
+  }
+  it = fill_halt(it);
+  std::size_t const program_size = it - bytes.begin();
+
+  std::stringstream expected;
+  Stream_decoder expected_printer(expected);
+  decode(bytes.begin(), bytes.end(), expected_printer);
+
+  for(std::size_t chunk_size : {1, 2, 3, 7, 64, 2048}) {
+    std::stringstream chunked;
+    Stream_decoder chunked_printer(chunked);
+    Stream_decode_context<Stream_decoder> ctx(chunked_printer);
+    std::size_t const max_inst_size = ctx.max_inst_size;
+
+    std::size_t consumed = 0;
+    for(std::size_t i=0; i<bytes.size(); i+=chunk_size) {
+      auto const a = bytes.begin() + i;
+      auto const b = bytes.begin() + std::min(bytes.size(), i + chunk_size);
+      consumed += ctx.feed(a, b);
+      EXPECT_LT(ctx.pending(), max_inst_size);
+    }
+
+    EXPECT_TRUE(ctx.halted());
+    EXPECT_EQ(0, ctx.pending());
+    EXPECT_EQ(program_size, consumed);
+    EXPECT_EQ(expected.str(), chunked.str()) << "chunk size " << chunk_size;
+  }
+}
+
+
 TEST(uni, rw_extract) {
   using namespace uni;
 
@@ -197,6 +611,396 @@ TEST(uni, rw_extract) {
 }
 
 
+TEST(uni, compact_rw_extract) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(64);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x10, 0xdeadface);
+  it = fill_wait_for_7(it, 113);
+  it = fill_read(it, 0x20);
+  it = fill_read(it, 0x21);
+  it = fill_write(it, 0x22, 0xcafe);
+  it = fill_halt(it);
+
+  Compact_rw_extract_decoder dec;
+  decode(bytes.cbegin(), bytes.cend(), dec);
+
+  std::vector<Rw_access> const expected{
+    {0x10, 0xdeadface, true},
+    {0x20, 0, false},
+    {0x21, 0, false},
+    {0x22, 0xcafe, true}};
+  EXPECT_EQ(expected, dec.extracted);
+}
+
+
+namespace {
+
+  /** Decoder without views that counts the Raw_inst it receives although
+   * it does not handle RAW. */
+  struct Raw_inst_counter {
+    typedef uni::Inst_set<uni::Write_inst> handled_instructions;
+
+    std::size_t raw = 0;
+    std::size_t writes = 0;
+
+    void operator () (uni::Raw_inst const&) {
+      ++raw;
+    }
+
+    void operator () (uni::Write_inst const&) {
+      ++writes;
+    }
+
+    template<typename T> void operator () (T const&) {
+    }
+  };
+
+}
+
+
+TEST(uni, fan_out_decoder) {
+  using namespace uni;
+
+  std::vector<Byte> bytes(256);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x10, 0xdeadface);
+  it = fill_raw(it, std::vector<Byte>{0x44, 0x45, 0x04, 0x80});
+  it = fill_wait_for_7(it, 113);
+  *it++ = 0x0f;
+  it = fill_data(it, uint64_t(0x12));
+  *it++ = 0x00;
+  it = fill_read(it, 0x20);
+  it = fill_wait_for_16(it, 0xfeef);
+  *it++ = 0x0f;
+  it = fill_data(it, uint64_t(0xc0000000 | (1 << 20) | (2 << 10) | 3));
+  *it++ = 0x00;
+  it = fill_raw(it, std::vector<Byte>{0x4c, 0x40});
+  it = fill_halt(it);
+
+  Standard_spiketrain_and_madc_decoder spikes;
+  Rw_extract_decoder rw;
+  Raw_extract_decoder raw;
+  Reference_raw_decoder raw_copy(false);
+  auto dec = fan_out(spikes, rw, raw, raw_copy);
+  EXPECT_TRUE(detail::Wants_raw_view<decltype(dec)>::value);
+  auto stop = decode(bytes.cbegin(), bytes.cend(), dec);
+  EXPECT_EQ(it - bytes.begin(), stop - bytes.cbegin());
+
+  Standard_spiketrain_and_madc_decoder ref_spikes;
+  decode(bytes.cbegin(), bytes.cend(), ref_spikes);
+  Rw_extract_decoder ref_rw;
+  decode(bytes.cbegin(), bytes.cend(), ref_rw);
+  Raw_extract_decoder ref_raw;
+  decode(bytes.cbegin(), bytes.cend(), ref_raw);
+
+  EXPECT_EQ(ref_spikes.cur_t, spikes.cur_t);
+  ASSERT_EQ(1, spikes.extracted_spikes.size());
+  EXPECT_EQ(ref_spikes.extracted_spikes, spikes.extracted_spikes);
+  ASSERT_EQ(3, spikes.extracted_samples.size());
+  EXPECT_EQ(ref_spikes.extracted_samples, spikes.extracted_samples);
+
+  ASSERT_EQ(2, rw.extracted.size());
+  EXPECT_EQ(0xdeadface, rw.extracted[0].write.data);
+  EXPECT_EQ(0x20, rw.extracted[1].read.address);
+
+  ASSERT_EQ(ref_raw.extracted.size(), raw.extracted.size());
+  EXPECT_FALSE(raw.extracted.empty());
+  EXPECT_EQ(ref_raw.extracted, raw.extracted);
+  EXPECT_EQ(ref_raw.extracted, raw_copy.extracted);
+
+  // without decoders that take RAW as Raw_inst, nothing is copied
+  bool const copies = decltype(dec)::raw_copy;
+  EXPECT_TRUE(copies);
+
+  Raw_inst_counter counter;
+  auto no_copy_dec = fan_out(spikes, rw, raw, counter);
+  bool const no_copies = decltype(no_copy_dec)::raw_copy;
+  EXPECT_FALSE(no_copies);
+  decode(bytes.cbegin(), bytes.cend(), no_copy_dec);
+  EXPECT_EQ(0, counter.raw);
+  EXPECT_EQ(1, counter.writes);
+}
+
+
+namespace {
+
+  /** Counts all instructions it is passed, but only handles WRITE and
+   * RAW. */
+  struct Filtered_decoder {
+    typedef uni::Inst_set<uni::Write_inst, uni::Raw_inst> handled_instructions;
+
+    std::size_t writes = 0;
+    std::size_t raws = 0;
+    std::size_t others = 0;
+
+    template<typename T> void operator () (T const& /*inst*/) {
+      ++others;
+    }
+
+    void operator () (uni::Write_inst const& /*inst*/) {
+      ++writes;
+    }
+
+    void operator () (uni::Raw_inst const& /*inst*/) {
+      ++raws;
+    }
+  };
+
+}
+
+
+TEST(uni, filtered_decoding) {
+  using namespace uni;
+
+  EXPECT_TRUE((Inst_set<Write_inst, Raw_view>::contains(Inst_id::raw)));
+  EXPECT_FALSE((Inst_set<Write_inst, Raw_view>::contains(Inst_id::read)));
+  EXPECT_FALSE(Inst_set<>::contains(Inst_id::halt));
+
+  std::vector<Byte> bytes(128);
+  auto it = fill_set_time(bytes.begin(), 9);
+  it = fill_write(it, 0x10, 0xdeadface);
+  it = fill_raw(it, std::vector<Byte>{0x01, 0x02, 0x03});
+  it = fill_read(it, 0x20);
+  it = fill_wait_for_7(it, 113);
+  it = fill_write(it, 0x11, 0xcafe);
+  *it++ = 0x0f;
+  it = fill_data(it, uint64_t(0x12));
+  *it++ = 0x00;
+  it = fill_raw(it, std::vector<Byte>{});
+  it = fill_wait_for_32(it, 0xdeadface);
+  it = fill_halt(it);
+  it = fill_write(it, 0x12, 0xcafe);
+  auto const end = it - bytes.begin() - inst_size(Inst_id::write);
+
+  Filtered_decoder dec;
+  auto stop = decode(bytes.cbegin(), bytes.cend(), dec);
+  EXPECT_EQ(end, stop - bytes.cbegin());
+  EXPECT_EQ(2, dec.writes);
+  EXPECT_EQ(2, dec.raws);
+  EXPECT_EQ(0, dec.others);
+
+  std::list<Byte> list(bytes.begin(), bytes.end());
+  Filtered_decoder list_dec;
+  decode(list.begin(), list.end(), list_dec);
+  EXPECT_EQ(2, list_dec.writes);
+  EXPECT_EQ(2, list_dec.raws);
+  EXPECT_EQ(0, list_dec.others);
+
+  // incomplete skipped instruction
+  Filtered_decoder cut_dec;
+  auto const cut = bytes.cbegin() + 1 + sizeof(Time) + 1;
+  EXPECT_EQ(cut - 1, decode(bytes.cbegin(), cut, cut_dec));
+  EXPECT_EQ(0, cut_dec.writes);
+
+  // fan-out handles the union
+  Rw_extract_decoder rw;
+  auto fan = fan_out(dec, rw);
+  typedef decltype(fan)::handled_instructions Handled;
+  EXPECT_TRUE(Handled::contains(Inst_id::read));
+  EXPECT_TRUE(Handled::contains(Inst_id::raw));
+  EXPECT_FALSE(Handled::contains(Inst_id::fire_one));
+  decode(bytes.cbegin(), bytes.cend(), fan);
+  EXPECT_EQ(4, dec.writes);
+  EXPECT_EQ(1, dec.others);
+  EXPECT_EQ(3, rw.extracted.size());
+
+  Stream_decoder printer(std::cout);
+  EXPECT_TRUE(detail::Handled_instructions<decltype(printer)>::contains(
+        Inst_id::rec_start));
+}
+
+
+TEST(uni, columnar_spiketrain) {
+  using namespace uni;
+
+  std::mt19937 rng(7);
+  std::vector<Byte> bytes(16 * 1024);
+  auto it = fill_set_time(bytes.begin(), 1000);
+  while( bytes.end() - it > 64 ) {
+    it = fill_wait_for_7(it, rng() & 0x7f);
+    if( rng() % 4 == 0 )
+      it = fill_write(it, rng(), rng());
+    *it++ = 0x0f;
+    it = fill_data(it, (uint64_t(rng() % 4) << 30) | (rng() & 0x3fffffff));
+    *it++ = 0x00;
+  }
+  it = fill_halt(it);
+
+  Standard_spiketrain_and_madc_decoder ref;
+  decode(bytes.cbegin(), bytes.cend(), ref);
+
+  auto const count = count_spikes_and_samples(bytes.cbegin(), bytes.cend());
+  EXPECT_EQ(ref.extracted_spikes.size(), count.spikes);
+  EXPECT_EQ(ref.extracted_samples.size(), count.samples);
+
+  Standard_columnar_spiketrain_and_madc_decoder dec;
+  dec.reserve(count);
+  auto const spike_times = dec.spikes.time.data();
+  auto const sample_values = dec.samples.value.data();
+  decode(bytes.cbegin(), bytes.cend(), dec);
+
+  // no reallocation after reserve()
+  EXPECT_EQ(spike_times, dec.spikes.time.data());
+  EXPECT_EQ(sample_values, dec.samples.value.data());
+
+  EXPECT_EQ(ref.cur_t, dec.cur_t);
+  ASSERT_EQ(ref.extracted_spikes.size(), dec.spikes.size());
+  ASSERT_EQ(dec.spikes.size(), dec.spikes.address.size());
+  for(std::size_t i=0; i<dec.spikes.size(); ++i) {
+    EXPECT_EQ(ref.extracted_spikes[i].time, dec.spikes.time[i]);
+    EXPECT_EQ(ref.extracted_spikes[i].address, dec.spikes.address[i]);
+  }
+  ASSERT_EQ(ref.extracted_samples.size(), dec.samples.size());
+  ASSERT_EQ(dec.samples.size(), dec.samples.value.size());
+  for(std::size_t i=0; i<dec.samples.size(); ++i) {
+    EXPECT_EQ(ref.extracted_samples[i].time, dec.samples.time[i]);
+    EXPECT_EQ(ref.extracted_samples[i].value, dec.samples.value[i]);
+  }
+}
+
+
+TEST(uni, madc_runs) {
+  using namespace uni;
+
+  // runs of FIRE_ONE instructions, mostly with three MADC samples
+  std::mt19937 rng(11);
+  std::vector<Byte> bytes(64 * 1024);
+  auto it = fill_set_time(bytes.begin(), 1000);
+  while( bytes.end() - it > 512 ) {
+    unsigned const n = rng() % 40;
+    for(unsigned i=0; i<n; ++i) {
+      uint64_t const key = (rng() % 8 == 0) ? rng() % 3 : 3;
+      *it++ = 0x0f;
+      it = fill_data(it, (key << 30) | (rng() & 0x3fffffff)
+          | (uint64_t(rng()) << 32));
+      *it++ = 0x00;
+    }
+    it = fill_wait_for_7(it, 1 + rng() % 0x7f);
+  }
+  it = fill_halt(it);
+
+  Standard_spiketrain_and_madc_decoder ref;
+  decode(bytes.cbegin(), bytes.cend(), ref);
+
+  Standard_columnar_spiketrain_and_madc_decoder dec;
+  Standard_spiketrain_and_madc_decoder fanned;
+  auto fan = fan_out(dec, fanned);
+  decode(bytes.cbegin(), bytes.cend(), fan);
+
+  std::list<Byte> list(bytes.begin(), bytes.end());
+  Standard_columnar_spiketrain_and_madc_decoder list_dec;
+  decode(list.begin(), list.end(), list_dec);
+
+  EXPECT_EQ(ref.extracted_spikes, fanned.extracted_spikes);
+  EXPECT_EQ(ref.extracted_samples, fanned.extracted_samples);
+  for(auto const* d : {&dec, &list_dec}) {
+    ASSERT_EQ(ref.extracted_spikes.size(), d->spikes.size());
+    for(std::size_t i=0; i<d->spikes.size(); ++i) {
+      EXPECT_EQ(ref.extracted_spikes[i].time, d->spikes.time[i]);
+      EXPECT_EQ(ref.extracted_spikes[i].address, d->spikes.address[i]);
+    }
+    ASSERT_EQ(ref.extracted_samples.size(), d->samples.size());
+    ASSERT_EQ(ref.extracted_samples.size(), d->samples.value.size());
+    for(std::size_t i=0; i<d->samples.size(); ++i) {
+      ASSERT_EQ(ref.extracted_samples[i].time, d->samples.time[i]) << i;
+      ASSERT_EQ(ref.extracted_samples[i].value, d->samples.value[i]) << i;
+    }
+  }
+
+  // errors in a run are still reported
+  Byte const bad[] = { 0x0f, 0, 0, 0, 0, 0xc0, 0, 0, 0, 0x01, 0x0e };
+  Standard_columnar_spiketrain_and_madc_decoder bad_dec;
+  EXPECT_THROW(decode(std::begin(bad), std::end(bad), bad_dec), Decode_error);
+}
+
+
+namespace {
+
+  /** Time tracking with one call per WAIT_FOR_7 instruction. */
+  struct Single_wait_decoder : uni::Time_tracking_decoder {
+    static bool const wait_for_7_runs = false;
+
+    std::size_t waits = 0;
+
+    using Time_tracking_decoder::operator ();
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void operator () (uni::Wait_for_7_inst const& inst) {
+      ++waits;
+      Time_tracking_decoder::operator () (inst);
+    }
+  };
+
+  /** Time tracking with runs of WAIT_FOR_7 instructions. */
+  struct Wait_run_decoder : uni::Time_tracking_decoder {
+    std::size_t runs = 0;
+    std::size_t waits = 0;
+
+    using Time_tracking_decoder::operator ();
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void operator () (uni::Wait_for_7_run const& inst) {
+      ++runs;
+      waits += inst.size;
+      Time_tracking_decoder::operator () (inst);
+    }
+  };
+
+}
+
+
+TEST(uni, wait_for_7_runs) {
+  using namespace uni;
+
+  std::mt19937 rng(3);
+  std::vector<Byte> bytes(64 * 1024);
+  std::size_t num_runs = 0;
+  auto it = fill_set_time(bytes.begin(), 1000);
+  while( bytes.end() - it > 512 ) {
+    unsigned const n = 1 + rng() % 100;
+    for(unsigned i=0; i<n; ++i)
+      it = fill_wait_for_7(it, rng() & 0x7f);
+    ++num_runs;
+    it = fill_wait_for_16(it, rng() & 0xffff);
+  }
+  it = fill_halt(it);
+
+  Single_wait_decoder ref;
+  decode(bytes.cbegin(), bytes.cend(), ref);
+
+  Wait_run_decoder dec;
+  decode(bytes.cbegin(), bytes.cend(), dec);
+  EXPECT_EQ(ref.cur_t, dec.cur_t);
+  EXPECT_EQ(ref.waits, dec.waits);
+  EXPECT_EQ(num_runs, dec.runs);
+
+  // per instruction for other iterators and other decoders of a fan-out
+  std::list<Byte> list(bytes.begin(), bytes.end());
+  Single_wait_decoder list_ref;
+  decode(list.begin(), list.end(), list_ref);
+  EXPECT_EQ(ref.cur_t, list_ref.cur_t);
+
+  Wait_run_decoder fanned;
+  Single_wait_decoder fanned_ref;
+  auto fan = fan_out(fanned, fanned_ref);
+  decode(bytes.cbegin(), bytes.cend(), fan);
+  EXPECT_EQ(ref.cur_t, fanned.cur_t);
+  EXPECT_EQ(num_runs, fanned.runs);
+  EXPECT_EQ(ref.cur_t, fanned_ref.cur_t);
+  EXPECT_EQ(ref.waits, fanned_ref.waits);
+
+  Standard_spiketrain_and_madc_decoder spikes;
+  decode(bytes.cbegin(), bytes.cend(), spikes);
+  EXPECT_EQ(ref.cur_t, spikes.cur_t);
+}
+
+
 TEST(uni, program_builder) {
   using namespace uni;
 
@@ -213,6 +1017,862 @@ TEST(uni, program_builder) {
   }
 }
 
+
+namespace {
+
+  /** Allocator with non-random-access iterators to exercise the generic
+   * capacity checks of Program_builder. */
+  struct Byte_list_allocator {
+    static size_t const block_size = 4096;
+    typedef std::list<uni::Byte> Container;
+    typedef std::list<uni::Byte>::iterator Iterator;
+
+    Iterator begin(Container& c) {
+      return std::begin(c);
+    }
+
+    Iterator end(Container& c) {
+      return std::end(c);
+    }
+
+    Container allocate(size_t capacity) {
+      return Container(capacity);
+    }
+  };
+
+
+  template<typename Allocator>
+  void fill_exactly_one_block(uni::Program_builder<Allocator>& bld) {
+    // 455 writes of 9 bytes and one wait_for_7 fill 4096 bytes
+    for(int i=0; i<455; ++i)
+      bld.write(i, 0xdeadface);
+    bld.wait_for(1);
+  }
+
+}
+
+
+TEST(uni, program_builder_block_boundary) {
+  using namespace uni;
+
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> bld(alloc);
+
+  fill_exactly_one_block(bld);
+  ASSERT_EQ(1, bld.containers.size());
+
+  bld.write(455, 0xdeadface);
+  bld.halt();
+  ASSERT_EQ(2, bld.containers.size());
+
+  Rw_extract_decoder rws;
+  for(auto const& c : bld.containers)
+    decode(std::begin(c), std::end(c), rws);
+
+  ASSERT_EQ(456, rws.extracted.size());
+  for(size_t i=0; i<rws.extracted.size(); ++i)
+    EXPECT_EQ(i, rws.extracted[i].write.address);
+
+
+  Byte_list_allocator list_alloc;
+  Program_builder<Byte_list_allocator> list_bld(list_alloc);
+
+  fill_exactly_one_block(list_bld);
+  ASSERT_EQ(1, list_bld.containers.size());
+
+  list_bld.write(455, 0xdeadface);
+  list_bld.halt();
+  ASSERT_EQ(2, list_bld.containers.size());
+
+  for(size_t i=0; i<bld.containers.size(); ++i) {
+    EXPECT_TRUE(std::equal(std::begin(bld.containers[i]),
+          std::end(bld.containers[i]),
+          std::begin(list_bld.containers[i])));
+  }
+}
+
+
+namespace {
+
+  /** Allocator that runs out of memory after num_blocks blocks. */
+  struct Limited_allocator : uni::Byte_vector_allocator {
+    std::size_t num_blocks;
+
+    explicit Limited_allocator(std::size_t num_blocks)
+      : num_blocks(num_blocks) {
+    }
+
+    Container allocate(size_t capacity) {
+      if( num_blocks == 0 )
+        throw std::bad_alloc();
+      --num_blocks;
+      return Byte_vector_allocator::allocate(capacity);
+    }
+  };
+
+}
+
+
+TEST(uni, program_builder_failed_allocation) {
+  using namespace uni;
+
+  Limited_allocator alloc(1);
+  Program_builder<Limited_allocator> bld(alloc, true);
+
+  // 454 writes of 9 bytes and 5 wait_for_7 leave 5 bytes in the block
+  for(int i=0; i<454; ++i)
+    bld.write(i, 0xdeadface);
+  for(int i=0; i<5; ++i)
+    bld.wait_for(0);
+
+  // the block is padded before the failed allocation, so a smaller
+  // instruction must not be written into the padding afterwards
+  EXPECT_THROW(bld.write(454, 0xdeadface), std::bad_alloc);
+  EXPECT_THROW(bld.halt(), std::bad_alloc);
+  ASSERT_EQ(1, bld.containers.size());
+  auto const c = bld.containers[0];
+  EXPECT_TRUE(std::all_of(c.end() - 5, c.end(),
+        [](Byte b) { return b == 0x80; }));
+
+  alloc.num_blocks = 1;
+  bld.halt();
+  ASSERT_EQ(2, bld.containers.size());
+  EXPECT_EQ(inst_opcode(Inst_id::halt), bld.containers[1][0]);
+
+  auto const manifest = bld.manifest();
+  ASSERT_EQ(2, manifest.size());
+  EXPECT_EQ(459, manifest[0].num_instructions);
+  EXPECT_EQ(5, manifest[0].padding);
+  EXPECT_EQ(c.size(), manifest[1].offset);
+  EXPECT_EQ(1, manifest[1].num_instructions);
+
+  Rw_extract_decoder rws;
+  decode(std::begin(c), std::end(c), rws);
+  EXPECT_EQ(454, rws.extracted.size());
+}
+
+TEST(uni, program_builder_block_size) {
+  using namespace uni;
+
+  // 1820 writes of 9 bytes and 4 bytes of padding per block
+  std::size_t const block_size = 16 << 10;
+  Byte_vector_allocator alloc(block_size);
+  Program_builder<Byte_vector_allocator> bld(alloc);
+  for(int i=0; i<5000; ++i)
+    bld.write(i, 0xdeadface);
+  bld.halt();
+  ASSERT_EQ(3, bld.containers.size());
+
+  Rw_extract_decoder rws;
+  for(auto const& c : bld.containers) {
+    EXPECT_EQ(block_size, c.size());
+    decode(std::begin(c), std::end(c), rws);
+  }
+  ASSERT_EQ(5000, rws.extracted.size());
+
+  for(std::size_t i=0; i<2; ++i) {
+    auto const& c = bld.containers[i];
+    EXPECT_TRUE(std::all_of(c.end() - 4, c.end(),
+          [](Byte b) { return b == 0x80; }));
+    EXPECT_EQ(0x0a, *(c.end() - 4 - 9));
+  }
+
+  // blocks have to take the largest instruction
+  EXPECT_THROW(Byte_vector_allocator(8), std::invalid_argument);
+  EXPECT_THROW(Block_pool_allocator(8), std::invalid_argument);
+
+  Byte_vector_allocator changed;
+  changed.block_size = 8;
+  EXPECT_THROW(Program_builder<Byte_vector_allocator> too_small(changed),
+      std::invalid_argument);
+
+  Byte_vector_allocator smallest(detail::max_builder_inst_size());
+  Program_builder<Byte_vector_allocator> small_bld(smallest);
+  for(int i=0; i<10; ++i)
+    small_bld.write(i, 0xdeadface);
+  small_bld.halt();
+  EXPECT_LE(10, small_bld.containers.size());
+
+  Rw_extract_decoder small_rws;
+  for(auto const& c : small_bld.containers)
+    decode(std::begin(c), std::end(c), small_rws);
+  EXPECT_EQ(10, small_rws.extracted.size());
+}
+
+
+namespace {
+
+  /** Program of num_writes WRITE instructions, one block per 455. */
+  template<typename Allocator>
+  void build_writes(uni::Program_builder<Allocator>& bld,
+      std::size_t num_writes) {
+    for(std::size_t i=0; i<num_writes; ++i) {
+      bld.write(i, 0xdeadface);
+      bld.wait_for(1);
+    }
+    bld.halt();
+  }
+
+}
+
+
+TEST(uni, block_pool_allocator) {
+  using namespace uni;
+
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> ref(alloc);
+  build_writes(ref, 2000);
+  ref.finish();
+
+  Block_pool_allocator pool;
+  for(int i=0; i<3; ++i) {
+    Program_builder<Block_pool_allocator> bld(pool);
+    build_writes(bld, 2000);
+    bld.finish();
+    EXPECT_EQ(ref.containers, bld.containers);
+
+    pool.recycle(bld.containers);
+    EXPECT_TRUE(bld.containers.empty());
+    EXPECT_EQ(ref.containers.size(), pool.num_free());
+    EXPECT_EQ(ref.containers.size(), pool.num_allocated());
+  }
+
+  // smaller programs reuse dirty blocks, finish() pads what is left of
+  // the earlier program
+  {
+    Program_builder<Block_pool_allocator> bld(pool, true);
+    build_writes(bld, 10);
+    auto const& c = bld.containers[0];
+    std::size_t const used = validate(c.data(), c.data() + c.size()).end;
+    EXPECT_FALSE(std::all_of(c.begin() + used, c.end(),
+          [](Byte b) { return b == 0x80; }));
+
+    bld.finish();
+    ASSERT_EQ(1, bld.containers.size());
+    EXPECT_TRUE(std::all_of(c.begin() + used, c.end(),
+          [](Byte b) { return b == 0x80; }));
+    EXPECT_EQ(c.size() - used, bld.manifest().back().padding);
+
+    Rw_extract_decoder rws;
+    decode(c.begin(), c.end(), rws);
+    EXPECT_EQ(10, rws.extracted.size());
+    pool.recycle(bld.containers);
+  }
+  EXPECT_EQ(ref.containers.size(), pool.num_allocated());
+
+  pool.reserve(20);
+  EXPECT_EQ(20, pool.num_free());
+  EXPECT_EQ(20, pool.num_allocated());
+
+  // the vectors listing the blocks are recycled as well
+  Block_pool_allocator::Container const* list = nullptr;
+  for(int i=0; i<3; ++i) {
+    Program_builder<Block_pool_allocator> bld(pool,
+        pool.take_container_list());
+    build_writes(bld, 2000);
+    if( i > 0 ) {
+      EXPECT_EQ(list, bld.containers.data());
+    }
+    list = bld.containers.data();
+    pool.recycle(std::move(bld.containers));
+  }
+  EXPECT_EQ(20, pool.num_allocated());
+
+  // builders in several threads share the pool
+  std::vector<std::thread> threads;
+  for(int t=0; t<4; ++t) {
+    threads.emplace_back([&pool]{
+        for(int i=0; i<20; ++i) {
+          Program_builder<Block_pool_allocator> bld(pool,
+              pool.take_container_list());
+          build_writes(bld, 2000);
+          pool.recycle(std::move(bld.containers));
+        }
+      });
+  }
+  for(auto& th : threads)
+    th.join();
+
+  EXPECT_GE(4 * ref.containers.size(), pool.num_allocated());
+  EXPECT_EQ(pool.num_allocated(), pool.num_free());
+}
+
+
+TEST(uni, arena_allocator) {
+  using namespace uni;
+
+  std::size_t const block_size = Arena_allocator::block_size;
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> ref(alloc);
+  build_writes(ref, 2000);
+  ref.finish();
+  std::vector<Byte> bytes;
+  for(auto const& c : ref.containers)
+    bytes.insert(bytes.end(), c.begin(), c.end());
+
+  Arena_allocator arena(8 * block_size, 3 * block_size);
+  EXPECT_EQ(8 * block_size, arena.capacity());
+
+  for(int i=0; i<2; ++i) {
+    Program_builder<Arena_allocator> bld(arena);
+    build_writes(bld, 2000);
+    bld.finish();
+
+    // blocks are views of one contiguous span
+    ASSERT_EQ(ref.containers.size(), bld.containers.size());
+    for(std::size_t k=0; k<bld.containers.size(); ++k) {
+      EXPECT_EQ(arena.data() + k * block_size, bld.containers[k].data());
+      EXPECT_EQ(block_size, bld.containers[k].size());
+    }
+    ASSERT_EQ(bytes.size(), arena.size());
+    EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), arena.data()));
+
+    Rw_extract_decoder rws;
+    decode(arena.data(), arena.data() + arena.size(), rws);
+    EXPECT_EQ(2000, rws.extracted.size());
+
+    arena.reset();
+    EXPECT_EQ(0, arena.size());
+  }
+
+  // finish() overwrites the earlier program behind a smaller one
+  {
+    Program_builder<Arena_allocator> bld(arena);
+    build_writes(bld, 10);
+    bld.finish();
+    ASSERT_EQ(block_size, arena.size());
+    Byte const* const a = arena.data();
+    std::size_t const used = validate(a, a + block_size).end;
+    EXPECT_TRUE(std::all_of(a + used, a + block_size,
+          [](Byte b) { return b == 0x80; }));
+    arena.reset();
+  }
+
+  Program_builder<Arena_allocator> bld(arena);
+  EXPECT_THROW(build_writes(bld, 10000), std::bad_alloc);
+
+  // only the used part of a large arena is committed
+  Arena_allocator large(std::size_t(1) << 40);
+  Program_builder<Arena_allocator> large_bld(large);
+  build_writes(large_bld, 2000);
+  EXPECT_EQ(bytes.size(), large.size());
+}
+
+
+TEST(uni, aligned_allocator) {
+  using namespace uni;
+
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> ref(alloc);
+  build_writes(ref, 20000);
+
+  {
+    Aligned_allocator aligned;
+    Program_builder<Aligned_allocator> bld(aligned);
+    build_writes(bld, 20000);
+    ASSERT_EQ(ref.containers.size(), bld.containers.size());
+    for(std::size_t k=0; k<bld.containers.size(); ++k) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(bld.containers[k].data())
+          % sysconf(_SC_PAGESIZE));
+      EXPECT_TRUE(std::equal(ref.containers[k].begin(),
+            ref.containers[k].end(), bld.containers[k].begin()));
+    }
+  }
+
+  std::size_t const huge = Aligned_allocator::huge_page_size;
+  for(Huge_pages hp : { Huge_pages::none, Huge_pages::transparent,
+      Huge_pages::reserved }) {
+    for(std::size_t block_size : { std::size_t(64) << 10, huge }) {
+      Aligned_allocator aligned(block_size, hp);
+      Program_builder<Aligned_allocator> bld(aligned, true);
+      build_writes(bld, 20000);
+
+      Rw_extract_decoder rws;
+      for(auto const& c : bld.containers) {
+        EXPECT_EQ(block_size, c.size());
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(c.data())
+            % sysconf(_SC_PAGESIZE));
+        if( (hp != Huge_pages::none) && (block_size == huge) ) {
+          EXPECT_EQ(0, reinterpret_cast<uintptr_t>(c.data()) % huge);
+        }
+        decode(c.begin(), c.end(), rws);
+      }
+      EXPECT_EQ(20000, rws.extracted.size());
+      EXPECT_EQ((bld.containers.size() - 1) * block_size,
+          bld.manifest().back().offset);
+    }
+  }
+
+  // blocks have to take the largest instruction, FIRE_ONE
+  EXPECT_THROW(Aligned_allocator(9), std::invalid_argument);
+  Aligned_allocator smallest(inst_size(Inst_id::fire_one));
+  Program_builder<Aligned_allocator> bld(smallest);
+  // one WRITE and one WAIT_FOR_7 per block
+  build_writes(bld, 100);
+  EXPECT_EQ(101, bld.containers.size());
+}
+
+
+TEST(uni, mapped_file_allocator) {
+  using namespace uni;
+
+  std::size_t const block_size = Mapped_file_allocator::block_size;
+  std::string const path = ::testing::TempDir() + "uni-mapped-program";
+
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> ref(alloc);
+  build_writes(ref, 2000);
+  std::vector<Byte> bytes;
+  for(auto const& c : ref.containers)
+    bytes.insert(bytes.end(), c.begin(), c.end());
+
+  {
+    // grow the file by three blocks at a time
+    Mapped_file_allocator file(path, 64 * block_size, 3 * block_size);
+    Program_builder<Mapped_file_allocator> bld(file);
+    build_writes(bld, 2000);
+
+    ASSERT_EQ(ref.containers.size(), bld.containers.size());
+    for(std::size_t k=0; k<bld.containers.size(); ++k)
+      EXPECT_EQ(file.data() + k * block_size, bld.containers[k].data());
+    ASSERT_EQ(bytes.size(), file.size());
+    EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), file.data()));
+    file.sync();
+  }
+
+  {
+    Mapped_program program(path);
+    ASSERT_EQ(bytes.size(), program.size());
+    EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), program.begin()));
+
+    Rw_extract_decoder rws;
+    decode(program.begin(), program.end(), rws);
+    EXPECT_EQ(2000, rws.extracted.size());
+  }
+
+  {
+    Mapped_file_allocator file(path, 4 * block_size);
+    Program_builder<Mapped_file_allocator> bld(file);
+    EXPECT_THROW(build_writes(bld, 10000), std::bad_alloc);
+  }
+  EXPECT_EQ(4 * block_size, Mapped_program(path).size());
+
+  {
+    Mapped_file_allocator file(path);
+  }
+  EXPECT_EQ(0, Mapped_program(path).size());
+  std::remove(path.c_str());
+
+  EXPECT_THROW(Mapped_file_allocator(path + "-missing/program"),
+      std::system_error);
+  EXPECT_THROW(Mapped_program(path + "-missing"), std::system_error);
+}
+
+namespace {
+
+  /** Collects the time of every WRITE. */
+  struct Timed_write_decoder : uni::Time_tracking_decoder {
+    std::vector<std::pair<uni::Time, uni::Address>> writes;
+
+    using Time_tracking_decoder::operator ();
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void operator () (uni::Write_inst const& inst) {
+      writes.emplace_back(cur_t, inst.address);
+    }
+  };
+
+
+  /** Program of several blocks with all kinds of timing instructions. */
+  std::vector<uni::Byte> make_timed_program(std::size_t num_writes) {
+    using namespace uni;
+
+    std::mt19937 rng(5);
+    Byte_vector_allocator alloc;
+    Program_builder<Byte_vector_allocator> bld(alloc);
+
+    bld.set_time(100);
+    for(std::size_t i=0; i<num_writes; ++i) {
+      unsigned const r = rng() % 16;
+      if( r == 0 )
+        bld.wait_until(1000 * i);
+      else if( r < 4 )
+        bld.wait_for(rng() % 0x100000);
+      else
+        bld.wait_for(rng() % 0x80);
+      bld.write(i, 0);
+      if( r == 5 )
+        bld.read(i);
+    }
+    bld.halt();
+
+    std::vector<Byte> rv;
+    for(auto const& c : bld.containers)
+      rv.insert(rv.end(), c.begin(), c.end());
+    return rv;
+  }
+
+
+  template<typename Decoder>
+  std::vector<std::pair<uni::Time, uni::Address>> concat_writes(
+      std::vector<Decoder> const& decs) {
+    std::vector<std::pair<uni::Time, uni::Address>> rv;
+    for(auto const& d : decs)
+      rv.insert(rv.end(), d.writes.begin(), d.writes.end());
+    return rv;
+  }
+
+}
+
+
+TEST(uni, parallel_decode) {
+  using namespace uni;
+
+  std::size_t const block_size = Byte_vector_allocator::default_block_size;
+  std::vector<Byte> const bytes = make_timed_program(20000);
+  Byte const* const a = bytes.data();
+  Byte const* const b = a + bytes.size();
+  ASSERT_LT(10 * block_size, bytes.size());
+
+  Timed_write_decoder ref;
+  decode(a, b, ref);
+  ASSERT_EQ(20000, ref.writes.size());
+
+  auto const summary = summarize_time(a, b);
+  EXPECT_TRUE(summary.halted);
+  EXPECT_EQ(ref.cur_t, summary.apply(0));
+
+  auto const blocks = block_split_points(a, b, block_size, 4);
+  EXPECT_EQ(bytes.size() / block_size, blocks.size());
+  auto const block_decs = parallel_decode<Timed_write_decoder>(a, b, blocks, 4);
+  ASSERT_EQ(blocks.size(), block_decs.size());
+  EXPECT_EQ(ref.writes, concat_writes(block_decs));
+
+  auto const chunks = split_points(a, b, 1000);
+  EXPECT_LT(bytes.size() / 1000 / 2, chunks.size());
+  auto const chunk_decs = parallel_decode<Timed_write_decoder>(a, b, chunks, 3);
+  EXPECT_EQ(ref.writes, concat_writes(chunk_decs));
+  EXPECT_EQ(ref.cur_t, chunk_decs.back().cur_t);
+
+  // errors are reported in the calling thread
+  std::vector<Byte> bad(bytes);
+  bad[chunks[chunks.size() / 2].offset] = 0x03;
+  EXPECT_THROW(parallel_decode<Timed_write_decoder>(bad.data(),
+        bad.data() + bad.size(), chunks, 3), Decode_error);
+}
+
+
+TEST(uni, batch_decode) {
+  using namespace uni;
+
+  // buffers of very different sizes, so threads have to steal work
+  std::vector<std::vector<Byte>> buffers;
+  for(std::size_t i=0; i<40; ++i)
+    buffers.push_back(make_timed_program((i % 7 == 0) ? 5000 : i));
+
+  std::vector<Timed_write_decoder> ref;
+  for(auto const& buf : buffers) {
+    ref.emplace_back();
+    decode(buf.begin(), buf.end(), ref.back());
+  }
+
+  std::size_t made = 0;
+  auto const make = [&made]{
+    ++made;
+    return Timed_write_decoder();
+  };
+
+  for(std::size_t num_threads : { 1, 3, 8 }) {
+    made = 0;
+    auto const decs = batch_decode(buffers.begin(), buffers.end(), make,
+        num_threads);
+    EXPECT_EQ(buffers.size(), made);
+    ASSERT_EQ(buffers.size(), decs.size());
+    for(std::size_t i=0; i<buffers.size(); ++i) {
+      EXPECT_EQ(ref[i].writes, decs[i].writes);
+      EXPECT_EQ(ref[i].cur_t, decs[i].cur_t);
+    }
+  }
+
+  std::vector<std::vector<Byte>> const none;
+  EXPECT_TRUE(batch_decode(none.begin(), none.end(), make).empty());
+
+  // a pool keeps its threads for many calls
+  for(std::size_t num_threads : { 1, 3, 8 }) {
+    Worker_pool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.size());
+    for(int k=0; k<20; ++k) {
+      auto const decs = batch_decode(buffers.begin(), buffers.end(), make,
+          pool);
+      ASSERT_EQ(buffers.size(), decs.size());
+      for(std::size_t i=0; i<buffers.size(); ++i)
+        EXPECT_EQ(ref[i].writes, decs[i].writes);
+    }
+    EXPECT_TRUE(batch_decode(none.begin(), none.end(), make, pool).empty());
+  }
+
+  // errors are reported in the calling thread
+  Byte const first = buffers[13][0];
+  buffers[13][0] = 0x03;
+  EXPECT_THROW(batch_decode(buffers.begin(), buffers.end(), make, 4),
+      Decode_error);
+  Worker_pool pool(4);
+  EXPECT_THROW(batch_decode(buffers.begin(), buffers.end(), make, pool),
+      Decode_error);
+  buffers[13][0] = first;
+  EXPECT_EQ(buffers.size(),
+      batch_decode(buffers.begin(), buffers.end(), make, pool).size());
+}
+
+
+namespace {
+
+  /** Counts instructions by Inst_id and sums up the waiting time. */
+  struct Duration_decoder {
+    std::array<std::size_t, uni::num_inst_ids> counts{};
+    uni::Time t = 0;
+    uni::Time duration = 0;
+
+    template<typename T> void operator () (T const& inst) {
+      ++counts[static_cast<std::size_t>(uni::Inst_traits<T>::id)];
+      wait(inst);
+    }
+
+    template<typename T> void wait(T const& /*inst*/) {
+    }
+
+    void wait(uni::Set_time_inst const& inst) {
+      t = inst.t;
+    }
+
+    void wait(uni::Wait_until_inst const& inst) {
+      if( inst.t > t )
+        duration += inst.t - t;
+      t = inst.t;
+    }
+
+    void wait(uni::Wait_for_7_inst const& inst) {
+      t += inst.t;
+      duration += inst.t;
+    }
+
+    void wait(uni::Wait_for_16_inst const& inst) {
+      t += inst.t;
+      duration += inst.t;
+    }
+
+    void wait(uni::Wait_for_32_inst const& inst) {
+      t += inst.t;
+      duration += inst.t;
+    }
+  };
+
+}
+
+
+TEST(uni, summarize_program) {
+  using namespace uni;
+
+  // RAW data that looks like WAIT_FOR_7 must not be counted as such
+  std::vector<Byte> bytes(1 + 2 + 200 + 2 + 7);
+  auto it = fill_rec_start(bytes.begin());
+  it = fill_raw(it, std::vector<Byte>(200, 0x80));
+  fill_raw(it, std::vector<Byte>(7, 0x81));
+  std::vector<Byte> const program = make_timed_program(20000);
+  bytes.insert(bytes.end(), program.begin(), program.end());
+  Byte const* const a = bytes.data();
+  Byte const* const b = a + bytes.size();
+
+  Duration_decoder ref;
+  Byte const* const end = decode(a, b, ref);
+
+  Program_summary const s = summarize_program(a, b);
+  EXPECT_TRUE(s.halted);
+  EXPECT_EQ(static_cast<std::size_t>(end - a), s.end);
+  EXPECT_EQ(ref.t, s.t);
+  EXPECT_EQ(ref.duration, s.duration);
+  EXPECT_TRUE(ref.counts == s.counts);
+  EXPECT_EQ(1, s.count(Inst_id::halt));
+  EXPECT_EQ(20000, s.count(Inst_id::write));
+  EXPECT_EQ(1, s.count(Inst_id::rec_start));
+  EXPECT_EQ(2, s.count(Inst_id::raw));
+  EXPECT_EQ(summarize_time(a, b).apply(0), s.t);
+
+  std::size_t total = 0;
+  for(auto c : ref.counts)
+    total += c;
+  EXPECT_EQ(total, s.num_instructions());
+
+  // cut off instructions and unknown opcodes
+  Program_summary const cut = summarize_program(a, a + 150);
+  EXPECT_FALSE(cut.halted);
+  EXPECT_EQ(1, cut.end);
+  EXPECT_EQ(1, cut.num_instructions());
+  EXPECT_EQ(0, cut.t);
+
+  bytes[cut.end] = 0x03;
+  EXPECT_THROW(summarize_program(a, b), Decode_error);
+}
+
+
+TEST(uni, block_manifest) {
+  using namespace uni;
+
+  std::size_t const block_size = Byte_vector_allocator::default_block_size;
+  std::mt19937 rng(9);
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> bld(alloc, true);
+  Program_builder<Byte_vector_allocator> plain(alloc);
+  EXPECT_TRUE(plain.manifest().empty());
+
+  bld.set_time(1000);
+  for(std::size_t i=0; i<5000; ++i) {
+    unsigned const r = rng() % 8;
+    if( r == 0 )
+      bld.wait_until(1000 + 100 * i);
+    else
+      bld.wait_for(rng() % ((r < 3) ? 0x100000 : 0x80));
+    bld.write(i, i);
+    if( r == 3 )
+      bld.read(i);
+  }
+  bld.halt();
+
+  std::vector<Block_info> const manifest = bld.manifest();
+  ASSERT_EQ(bld.containers.size(), manifest.size());
+  ASSERT_LT(10, manifest.size());
+
+  Time t = 0;
+  for(std::size_t i=0; i<manifest.size(); ++i) {
+    Block_info const& info = manifest[i];
+    Byte const* const a = bld.containers[i].data();
+    Byte const* const used = a + block_size - info.padding;
+
+    EXPECT_EQ(i * block_size, info.offset);
+    EXPECT_EQ(t, info.start_t);
+    EXPECT_EQ(info.num_instructions, validate(a, used).count);
+    EXPECT_EQ(info.end_t, summarize_time(a, used).apply(info.start_t));
+    if( i + 1 < manifest.size() ) {
+      EXPECT_TRUE(std::all_of(used, a + block_size,
+            [](Byte b) { return b == 0x80; }));
+    }
+    t = info.end_t;
+  }
+
+  // the manifest replaces scanning for block boundaries
+  std::vector<Byte> bytes;
+  for(auto const& c : bld.containers)
+    bytes.insert(bytes.end(), c.begin(), c.end());
+  Byte const* const a = bytes.data();
+  Byte const* const b = a + bytes.size();
+
+  auto const scanned = block_split_points(a, b, block_size);
+  auto const splits = manifest_split_points(manifest);
+  ASSERT_EQ(scanned.size(), splits.size());
+  for(std::size_t i=0; i<splits.size(); ++i) {
+    EXPECT_EQ(scanned[i].offset, splits[i].offset);
+    EXPECT_EQ(scanned[i].t, splits[i].t);
+  }
+
+  // offsets add up the real sizes if the block size changes in between
+  Byte_vector_allocator changing;
+  Program_builder<Byte_vector_allocator> resized(changing, true);
+  for(std::size_t i=0; i<1000; ++i)
+    resized.write(i, i);
+  changing.block_size = 1024;
+  for(std::size_t i=0; i<1000; ++i)
+    resized.write(i, i);
+  resized.halt();
+
+  std::vector<Block_info> const resized_manifest = resized.manifest();
+  ASSERT_EQ(resized.containers.size(), resized_manifest.size());
+  EXPECT_EQ(block_size, resized.containers[1].size());
+  EXPECT_EQ(1024, resized.containers.back().size());
+  std::size_t offset = 0;
+  for(std::size_t i=0; i<resized_manifest.size(); ++i) {
+    EXPECT_EQ(offset, resized_manifest[i].offset);
+    offset += resized.containers[i].size();
+  }
+}
+
+
+TEST(uni, time_index) {
+  using namespace uni;
+
+  // recording-like program where the time never decreases
+  std::mt19937 rng(7);
+  Byte_vector_allocator alloc;
+  Program_builder<Byte_vector_allocator> bld(alloc);
+  Time t = 100;
+  bld.set_time(t);
+  for(std::size_t i=0; i<20000; ++i) {
+    unsigned const r = rng() % 16;
+    Time const dt = (r < 2) ? (rng() % 0x10000) : (rng() % 0x80);
+    t += dt;
+    if( r == 2 )
+      bld.set_time(t);
+    else
+      bld.wait_for(dt);
+    bld.write(i, 0);
+  }
+  bld.halt();
+
+  std::vector<Byte> bytes;
+  for(auto const& c : bld.containers)
+    bytes.insert(bytes.end(), c.begin(), c.end());
+  Byte const* const a = bytes.data();
+  Byte const* const b = a + bytes.size();
+
+  Timed_write_decoder ref;
+  Byte const* const halt_end = decode(a, b, ref);
+
+  Time_index const by_bytes = build_time_index(a, b, 1000);
+  EXPECT_LT(bytes.size() / 1000 / 2, by_bytes.checkpoints.size());
+  for(auto const& c : by_bytes.checkpoints)
+    EXPECT_EQ(summarize_time(a, a + c.offset).apply(0), c.t);
+
+  Time_index const by_insts = build_time_index(a, b, 0, 100);
+  for(std::size_t i=1; i<by_insts.checkpoints.size(); ++i) {
+    auto const v = validate(a + by_insts.checkpoints[i - 1].offset,
+        a + by_insts.checkpoints[i].offset);
+    EXPECT_EQ(100, v.count);
+    EXPECT_EQ(summarize_time(a, a + by_insts.checkpoints[i].offset).apply(0),
+        by_insts.checkpoints[i].t);
+  }
+
+  auto in_window = [](std::vector<std::pair<Time, Address>> const& writes,
+      Time begin, Time end) {
+    std::vector<std::pair<Time, Address>> rv;
+    for(auto const& w : writes)
+      if( (w.first >= begin) && (w.first < end) )
+        rv.push_back(w);
+    return rv;
+  };
+
+  for(Time begin : { Time(0), ref.writes[5000].first, ref.writes[5001].first,
+      ref.writes.back().first }) {
+    Time const end = begin + 20000;
+    for(Time_index const* idx : { &by_bytes, &by_insts }) {
+      Timed_write_decoder dec;
+      decode_window(a, b, *idx, begin, end, dec);
+      EXPECT_EQ(in_window(ref.writes, begin, end),
+          in_window(dec.writes, begin, end));
+      // only about one checkpoint interval is decoded around the window
+      EXPECT_GT(in_window(ref.writes, begin, end).size() + 400,
+          dec.writes.size());
+    }
+  }
+
+  // the end of the program
+  Timed_write_decoder dec;
+  EXPECT_EQ(halt_end, decode_window(a, b, by_bytes, ref.writes.back().first,
+        ref.cur_t + 1, dec));
+  EXPECT_EQ(ref.cur_t, dec.cur_t);
+}
+
+
 // Test was disabled, as there is no spike interface for v3 using the fire
 // instruction. This is not the case for v3.1. Enable as soon es spike encoding
 // is implemented vor v3.1.
@@ -3,25 +3,154 @@
 #include <uni/v2/types.h>
 #include <uni/v2/errors.h>
 
+#include <bitset>
+#include <cstring>
+#include <iterator>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 /** Top-level namespace for UNI */
 namespace uni {
 
 
+  namespace detail {
+
+    /** Whether the distance between two It can be computed in O(1). */
+    template<typename It, typename Enable = void>
+    struct Is_random_access : std::false_type {
+    };
+
+    template<typename It>
+    struct Is_random_access<It,
+      typename std::enable_if<std::is_base_of<
+        std::random_access_iterator_tag,
+        typename std::iterator_traits<It>::iterator_category>::value>::type>
+      : std::true_type {
+    };
+
+
+    /** Whether It points into contiguous memory of Bytes. Multi-byte
+     * fields are then accessed with a single load or store. */
+    template<typename It>
+    struct Is_contiguous_bytes : std::false_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<Byte*> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<Byte const*> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<std::vector<Byte>::iterator> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<std::vector<Byte>::const_iterator>
+      : std::true_type {
+    };
+
+
+    /** Unsigned integer with N bytes. */
+    template<std::size_t N>
+    struct Uint_of_size;
+
+    template<>
+    struct Uint_of_size<1> {
+      typedef uint8_t type;
+    };
+
+    template<>
+    struct Uint_of_size<2> {
+      typedef uint16_t type;
+    };
+
+    template<>
+    struct Uint_of_size<4> {
+      typedef uint32_t type;
+    };
+
+    template<>
+    struct Uint_of_size<8> {
+      typedef uint64_t type;
+    };
+
+
+    inline uint8_t big_endian_uint(uint8_t v) {
+      return v;
+    }
+
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    inline uint16_t big_endian_uint(uint16_t v) {
+      return __builtin_bswap16(v);
+    }
+
+    inline uint32_t big_endian_uint(uint32_t v) {
+      return __builtin_bswap32(v);
+    }
+
+    inline uint64_t big_endian_uint(uint64_t v) {
+      return __builtin_bswap64(v);
+    }
+#else
+    template<typename T>
+    T big_endian_uint(T v) {
+      Byte bytes[sizeof(T)];
+      for(std::size_t i=0; i<sizeof(T); i++)
+        bytes[i] = v >> ((sizeof(T) - i - 1) * 8);
+
+      T rv;
+      std::memcpy(&rv, bytes, sizeof(T));
+      return rv;
+    }
+#endif
+
+    /** Convert between host and big-endian (byte-code) byte order.
+     *
+     * Works on any integer type by its size, e.g. int and unsigned long
+     * long, which are not among the fixed-width types on every platform. */
+    template<typename T>
+    T big_endian(T v) {
+      typedef typename Uint_of_size<sizeof(T)>::type Uint;
+      return static_cast<T>(big_endian_uint(static_cast<Uint>(v)));
+    }
+
+
+    template<typename InOutIterator, typename T>
+    InOutIterator fill_data(InOutIterator it, T w, std::false_type) {
+      for(std::size_t i=0; i<sizeof(T); i++) {
+        T b = (w >> ((sizeof(T) - i - 1) * 8));
+        *it = b & 0xff;
+        ++it;
+      }
+      return it;
+    }
+
+    template<typename InOutIterator, typename T>
+    InOutIterator fill_data(InOutIterator it, T w, std::true_type) {
+      T const be = big_endian(w);
+      std::memcpy(&*it, &be, sizeof(T));
+      return it + sizeof(T);
+    }
+
+  }
+
+
   //---------------------------------------------------------------------------
   // Instruction coding
   //---------------------------------------------------------------------------
 
+  /** Write w in big-endian byte order.
+   *
+   * For contiguous byte buffers (see detail::Is_contiguous_bytes) this is a
+   * single byte-swapped store. */
   template<typename InOutIterator, typename T>
   InOutIterator fill_data(InOutIterator it, T w) {
-    for(std::size_t i=0; i<sizeof(T); i++) {
-      T b = (w >> ((sizeof(T) - i - 1) * 8));
-      *it = b & 0xff;
-      ++it;
-    }
-    return it;
+    return detail::fill_data(it, w,
+        typename detail::Is_contiguous_bytes<InOutIterator>::type());
   }
 
 #define FILL_INST_0(name) \
@@ -142,38 +271,76 @@ namespace uni {
   // Instruction classes
   //---------------------------------------------------------------------------
 
+  /** Identifiers of UNI instructions.
+   *
+   * Each Instruction carries its identifier instead of a name string, the
+   * name for pretty printing is looked up in a compile-time table by
+   * inst_name(). */
+  enum class Inst_id : uint8_t {
+    set_time,
+    wait_until,
+    write,
+    read,
+    halt,
+    wait_for_7,
+    wait_for_16,
+    wait_for_32,
+    raw,
+    rec_start,
+    rec_stop,
+    fire,
+    fire_one,
+  };
+
+
+  /** Name of the instruction identified by id. */
+  inline char const* inst_name(Inst_id id) {
+    static char const* const names[] = {
+      "set_time",
+      "wait_until",
+      "write",
+      "read",
+      "halt",
+      "wait_for_7",
+      "wait_for_16",
+      "wait_for_32",
+      "raw",
+      "rec_start",
+      "rec_stop",
+      "fire",
+      "fire_one",
+    };
+    return names[static_cast<std::size_t>(id)];
+  }
+
+
   /** Base class for UNI instructions.
    *
    * The derived classes of Instruction constitute the internal representation
    * of UNI instructions. The read_ functions implement decoding of these
    * instructions into buffers.
+   *
+   * Instructions are plain values without dynamic memory (except for the
+   * payload of Raw_inst), so decode() can construct them for every opcode
+   * at no cost.
    * */
   struct Instruction {
     /** Maximum length of names for pretty printing. */
     static int const name_width = 15;
 
-    /** Name of instruction. */
-    std::string const name;
+    /** Identifier of instruction. */
+    Inst_id id;
 
-    /** Construct named instruction.
+    /** Construct identified instruction.
      *
-     * @param name Name of the instruction. */
-    explicit Instruction(std::string const& name)
-      : name(name) {
+     * @param id Identifier of the instruction. */
+    explicit Instruction(Inst_id id)
+      : id(id) {
     }
 
-#if __cplusplus >= 201103L
-	/** Implictly-declared copy constructor needs to be explicitly
-	 * default-declared. */
-	Instruction(Instruction const&) = default;
-#endif
-
-    /** No-op assignment operator to allow for automatic deduction of
-     * assignment operators for derived classes.
-     * FIXME (ECM@2016-12-23): This is very unexpected behavior... we shall fix this.
-     */
-    Instruction const& operator=(Instruction const& /*other*/) {
-      return *this;
+    /** Name of instruction. */
+    char const* name() const {
+      return inst_name(id);
     }
   };
 
@@ -183,22 +350,22 @@ namespace uni {
     /** Time argument for this instruction. */
     Time t;
 
-    Timing_inst(std::string const& name)
-      : Instruction(name) {
+    explicit Timing_inst(Inst_id id)
+      : Instruction(id) {
     }
   };
 
 
   struct Set_time_inst : public Timing_inst {
     Set_time_inst()
-      : Timing_inst("set_time") {
+      : Timing_inst(Inst_id::set_time) {
     }
   };
 
 
   struct Wait_until_inst : public Timing_inst {
     Wait_until_inst()
-      : Timing_inst("wait_until") {
+      : Timing_inst(Inst_id::wait_until) {
     }
   };
 
@@ -207,7 +374,7 @@ namespace uni {
     Address address;
 
     Read_inst()
-      : Instruction("read") {
+      : Instruction(Inst_id::read) {
     }
   };
 
@@ -216,31 +383,31 @@ namespace uni {
     Word data;
 
     Write_inst()
-      : Instruction("write") {
+      : Instruction(Inst_id::write) {
     }
   };
 
   struct Halt_inst : public Instruction {
     Halt_inst()
-      : Instruction("halt") {
+      : Instruction(Inst_id::halt) {
     }
   };
 
   struct Wait_for_7_inst : public Timing_inst {
     Wait_for_7_inst()
-      : Timing_inst("wait_for_7") {
+      : Timing_inst(Inst_id::wait_for_7) {
     }
   };
 
   struct Wait_for_16_inst : public Timing_inst {
     Wait_for_16_inst()
-      : Timing_inst("wait_for_16") {
+      : Timing_inst(Inst_id::wait_for_16) {
     }
   };
 
   struct Wait_for_32_inst : public Timing_inst {
     Wait_for_32_inst()
-      : Timing_inst("wait_for_32") {
+      : Timing_inst(Inst_id::wait_for_32) {
     }
   };
 
@@ -248,7 +415,7 @@ namespace uni {
     std::vector<Byte> data;
 
     Raw_inst()
-      : Instruction("raw") {
+      : Instruction(Inst_id::raw) {
     }
 
     bool operator == (Raw_inst const& other) const {
@@ -259,13 +426,13 @@ namespace uni {
 
   struct Rec_start_inst : public Instruction {
     Rec_start_inst()
-      : Instruction("rec_start") {
+      : Instruction(Inst_id::rec_start) {
     }
   };
 
   struct Rec_stop_inst : public Instruction {
     Rec_stop_inst()
-      : Instruction("rec_stop") {
+      : Instruction(Inst_id::rec_stop) {
     }
   };
 
@@ -275,7 +442,7 @@ namespace uni {
     Event_address evaddr;
 
     Fire_inst()
-      : Instruction("fire") {
+      : Instruction(Inst_id::fire) {
     }
   };
 
@@ -284,11 +451,17 @@ namespace uni {
     Event_address evaddr;
 
     Fire_one_inst()
-      : Instruction("fire_one") {
+      : Instruction(Inst_id::fire_one) {
     }
   };
 
 
+  static_assert(std::is_trivially_copyable<Write_inst>::value
+      && std::is_trivially_copyable<Wait_for_7_inst>::value
+      && std::is_trivially_copyable<Fire_one_inst>::value,
+      "Instructions are supposed to be plain values");
+
+
   //---------------------------------------------------------------------------
   // Output operators
   //---------------------------------------------------------------------------
@@ -296,7 +469,7 @@ namespace uni {
 
   inline std::ostream& operator << (std::ostream& os, Instruction const& inst) {
     return os << std::setfill(' ') << std::setw(inst.name_width)
-      << inst.name;
+      << inst.name();
   }
 
   inline std::ostream& operator << (std::ostream& os, Timing_inst const& inst) {
@@ -463,39 +636,89 @@ namespace uni {
 #undef READ_INST
 
 
-#define CHECK_INST(name, sz) \
+  /** Size of the byte-code of instruction id in bytes.
+   *
+   * RAW instructions have variable length, for them only the size of the
+   * header (opcode and length byte) is returned. */
+  constexpr std::size_t inst_size(Inst_id id) {
+    switch( id ) {
+      case Inst_id::set_time: return 1 + sizeof(Time);
+      case Inst_id::wait_until: return 1 + sizeof(Time);
+      case Inst_id::write: return 1 + sizeof(Address) + sizeof(Word);
+      case Inst_id::read: return 1 + sizeof(Address);
+      case Inst_id::halt: return 1;
+      case Inst_id::wait_for_7: return 1;
+      case Inst_id::wait_for_16: return 1 + sizeof(uint16_t);
+      case Inst_id::wait_for_32: return 1 + sizeof(uint32_t);
+      case Inst_id::raw: return 2;
+      case Inst_id::rec_start: return 1;
+      case Inst_id::rec_stop: return 1;
+      case Inst_id::fire: return 1 + sizeof(uint64_t) + sizeof(Event_address);
+      case Inst_id::fire_one: return 1 + sizeof(Event_address);
+    }
+    return 0;
+  }
+
+
+  namespace detail {
+
+    template<typename InputIt>
+    bool check_size(InputIt a, InputIt stop, std::size_t sz, std::true_type) {
+      return stop - a >= static_cast<std::ptrdiff_t>(sz);
+    }
+
+    template<typename InputIt>
+    bool check_size(InputIt a, InputIt stop, std::size_t sz, std::false_type) {
+      for(size_t i=0; i<sz; ++i) {
+        if( a == stop )
+          return false;
+        ++a;
+      }
+      return true;
+    }
+
+  }
+
+
+  /** Check if there are at least sz bytes between a and stop.
+   *
+   * This is a single comparison for random-access iterators, other
+   * iterators are advanced up to sz times. */
+  template<typename InputIt>
+  bool check_size(InputIt a, InputIt stop, std::size_t sz) {
+    return detail::check_size(a, stop, sz,
+        typename detail::Is_random_access<InputIt>::type());
+  }
+
+
+#define CHECK_INST(name) \
   template<typename InputIt> \
   bool check_ ## name (InputIt a, InputIt stop) { \
-    for(size_t i=0; i< sz ; ++i) \
-      if( ++a == stop ) \
-        return false; \
-    return true; \
-  }
-
-  CHECK_INST(set_time, 1 + sizeof(Time))
-  CHECK_INST(wait_until, 1 + sizeof(Time))
-  CHECK_INST(write, 1 + sizeof(Address) + sizeof(Word))
-  CHECK_INST(read, 1 + sizeof(Word))
-  CHECK_INST(halt, 1)
-  CHECK_INST(wait_for_16, 1 + sizeof(uint16_t))
-  CHECK_INST(wait_for_32, 1 + sizeof(uint32_t))
-  CHECK_INST(rec_start, 1)
-  CHECK_INST(rec_stop, 1)
-  CHECK_INST(wait_for_7, 1)
-  CHECK_INST(fire, 1 + sizeof(uint64_t) + sizeof(uint8_t))
-  CHECK_INST(fire_one, 1 + sizeof(uint8_t))
+    return check_size(a, stop, inst_size(Inst_id::name)); \
+  }
+
+  CHECK_INST(set_time)
+  CHECK_INST(wait_until)
+  CHECK_INST(write)
+  CHECK_INST(read)
+  CHECK_INST(halt)
+  CHECK_INST(wait_for_16)
+  CHECK_INST(wait_for_32)
+  CHECK_INST(rec_start)
+  CHECK_INST(rec_stop)
+  CHECK_INST(wait_for_7)
+  CHECK_INST(fire)
+  CHECK_INST(fire_one)
 
   template<typename InputIt>
   bool check_raw(InputIt a, InputIt stop) {
-    if( ++a == stop )
+    if( !check_size(a, stop, inst_size(Inst_id::raw)) )
       return false;
 
+    ++a;
     uint8_t sz = *a;
-    for(size_t i=0; i<sz; ++i)
-      if( ++a == stop )
-        return false;
-
-    return true;
+    ++a;
+    return check_size(a, stop, sz);
   }
 
 #undef CHECK_INST
@@ -7,11 +7,44 @@
 #include <cereal/cereal.hpp>
 #include <cereal/types/vector.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 
 namespace uni {
 
+  namespace detail {
+
+    /** Size of the largest instruction that Program_builder emits. */
+    constexpr std::size_t max_builder_inst_size() {
+      return std::max({ inst_size(Inst_id::set_time),
+          inst_size(Inst_id::wait_until), inst_size(Inst_id::write),
+          inst_size(Inst_id::wait_for_32), inst_size(Inst_id::wait_for_16),
+          inst_size(Inst_id::wait_for_7), inst_size(Inst_id::read),
+          inst_size(Inst_id::fire), inst_size(Inst_id::fire_one),
+          inst_size(Inst_id::halt) });
+    }
+
+    /** Check that blocks of block_size can take every instruction of
+     * Program_builder, for allocators with a block size set at runtime.
+     *
+     * @returns block_size
+     * @throws std::invalid_argument if block_size is too small. */
+    inline std::size_t checked_block_size(std::size_t block_size) {
+      if( block_size < max_builder_inst_size() )
+        throw std::invalid_argument("block size "
+            + std::to_string(block_size) + " is smaller than the largest"
+            " instruction of " + std::to_string(max_builder_inst_size())
+            + " bytes");
+      return block_size;
+    }
+
+  }
+
+
   /** Build programs out of UNI instructions.
    *
    * @tparam Allocator Object to create buffer blocks.
@@ -32,31 +65,26 @@ namespace uni {
 
       Program_builder(Allocator& alloc)
         : m_alloc(alloc) {
-        containers.push_back(alloc.allocate(Allocator::block_size));
-        m_it = alloc.begin(containers.back());
-        m_stop = alloc.end(containers.back());
+        next_block();
       }
 
 
       void set_time(Time t) {
-        if( !check_set_time(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::set_time));
 
         m_it = fill_set_time(m_it, t);
       }
 
 
       void wait_until(Time t) {
-        if( !check_wait_until(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::wait_until));
 
         m_it = fill_wait_until(m_it, t);
       }
 
 
       void write(Address addr, Word data) {
-        if( !check_write(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::write));
 
         m_it = fill_write(m_it, addr, data);
       }
@@ -67,41 +95,35 @@ namespace uni {
           throw Encode_error(__func__, "wait_for_*",
               "Delay exceeds wait_for_32. Use wait_until instead.");
         } else if( t > 0xfffful ) {
-          if( !check_wait_for_32(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_32));
 
           m_it = fill_wait_for_32(m_it, t);
         } else if( t > 0x7ful ) {
-          if( !check_wait_for_16(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_16));
 
           m_it = fill_wait_for_16(m_it, t);
         } else {
-          if( !check_wait_for_7(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_7));
           m_it = fill_wait_for_7(m_it, t);
         }
       }
 
 
       void read(Address addr) {
-        if( !check_read(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::read));
 
         m_it = fill_read(m_it, addr);
       }
 
 
       void fire(Fire_set fire, Event_address evaddr) {
-        if( !check_fire(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::fire));
         m_it = fill_fire(m_it, fire, evaddr);
       }
 
 
       void fire_one(uint8_t index, Event_address evaddr) {
-        if( !check_fire_one(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::fire_one));
         m_it = fill_fire_one(m_it, index, evaddr);
       }
 
@@ -146,8 +168,7 @@ namespace uni {
 
 
       void halt() {
-        if( !check_halt(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::halt));
 
         m_it = fill_halt(m_it);
       }
@@ -163,19 +184,73 @@ namespace uni {
 
 
     protected:
+      /** Allocator::Iterator allows for O(1) capacity checks. */
+      typedef typename detail::Is_random_access<
+        typename Allocator::Iterator>::type Random_access;
+
       Allocator& m_alloc;
       typename Allocator::Iterator m_it, m_stop;
 
+      /** Bytes left in the current block. Only maintained for random-access
+       * iterators, other iterators are checked by walking up to m_stop. */
+      std::size_t m_remaining = 0;
+
+
+      /** Ensure the current block can take sz more bytes and account for
+       * them. */
+      void reserve(std::size_t sz) {
+        reserve(sz, Random_access());
+      }
+
+      void reserve(std::size_t sz, std::true_type) {
+        if( m_remaining < sz )
+          alloc();
+        m_remaining -= sz;
+      }
+
+      void reserve(std::size_t sz, std::false_type) {
+        if( !check_size(m_it, m_stop, sz) )
+          alloc();
+      }
+
+      void update_remaining(std::true_type) {
+        m_remaining = m_stop - m_it;
+      }
+
+      void update_remaining(std::false_type) {
+      }
+
 
       void alloc() {
-        // fill with no-ops
+        pad(typename detail::Is_contiguous_bytes<
+            typename Allocator::Iterator>::type());
+        // the block stays full if allocate() throws
+        m_remaining = 0;
+        next_block();
+      }
+
+      /** Fill the rest of the block with no-ops, i.e. WAIT_FOR_7 with t = 0,
+       * at once for contiguous blocks. */
+      void pad(std::true_type) {
+        if( m_it != m_stop ) {
+          std::memset(&*m_it, 0x80, m_stop - m_it);
+          m_it = m_stop;
+        }
+      }
+
+      void pad(std::false_type) {
         while( m_it != m_stop ) {
           m_it = fill_wait_for_7(m_it, 0);
         }
+      }
 
-        containers.push_back(m_alloc.allocate(Allocator::block_size));
+      void next_block() {
+        // also catches block sizes changed after construction
+        containers.push_back(m_alloc.allocate(
+              detail::checked_block_size(m_alloc.block_size)));
         m_it = m_alloc.begin(containers.back());
         m_stop = m_alloc.end(containers.back());
+        update_remaining(Random_access());
       }
     private:
       friend class cereal::access;
@@ -196,6 +271,7 @@ namespace uni {
         std::ptrdiff_t diff_stop;
         ar(CEREAL_NVP_("stop", diff_stop));
         m_stop = m_alloc.begin(containers.back()) + diff_stop;
+        update_remaining(Random_access());
       }
   };
 
@@ -203,9 +279,14 @@ namespace uni {
   /** Simple allocator for use with Program_builder.
    *
    * Creates std::vector<Byte> as buffer block with a maximum size of block_size.
+   * The block size can be chosen at construction, e.g. to match the maximum
+   * transfer size of the transport.
    * */
   struct Byte_vector_allocator {
-    static size_t const block_size = 4096;
+    static size_t const default_block_size = 4096;
+
+    /** Size of the blocks for Program_builder. */
+    size_t block_size = default_block_size;
 
     /** Container type to use by Program_builder. */
     typedef std::vector<Byte> Container;
@@ -215,6 +296,13 @@ namespace uni {
     typedef std::vector<Byte>::const_iterator Const_iterator;
 
 
+    /** @throws std::invalid_argument if block_size is smaller than the
+     * largest instruction. */
+    explicit Byte_vector_allocator(size_t block_size = default_block_size)
+      : block_size(detail::checked_block_size(block_size)) {
+    }
+
+
     /** Get Iterator to first byte in Container. */
     Iterator begin(Container& c) {
       return std::begin(c);
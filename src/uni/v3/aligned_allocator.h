@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "uni/v3/types.h"
+#include "uni/v3/program_builder.h"
+
+
+namespace uni {
+
+  /** Block of page-aligned memory from Aligned_allocator.
+   *
+   * Owns the memory and unmaps it on destruction, can only be moved. */
+  class Aligned_block {
+    public:
+      Aligned_block() {
+      }
+
+      /** Take ownership of the mapping [data, data + mapped_size) of which
+       * the first size bytes are used. */
+      Aligned_block(Byte* data, std::size_t size, std::size_t mapped_size)
+        : m_data(data), m_size(size), m_mapped_size(mapped_size) {
+      }
+
+      Aligned_block(Aligned_block&& other)
+        : m_data(other.m_data), m_size(other.m_size),
+          m_mapped_size(other.m_mapped_size) {
+        other.m_data = nullptr;
+        other.m_size = other.m_mapped_size = 0;
+      }
+
+      Aligned_block& operator = (Aligned_block&& other) {
+        if( this != &other ) {
+          release();
+          m_data = other.m_data;
+          m_size = other.m_size;
+          m_mapped_size = other.m_mapped_size;
+          other.m_data = nullptr;
+          other.m_size = other.m_mapped_size = 0;
+        }
+        return *this;
+      }
+
+      ~Aligned_block() {
+        release();
+      }
+
+      Aligned_block(Aligned_block const&) = delete;
+      Aligned_block& operator = (Aligned_block const&) = delete;
+
+
+      Byte* begin() const {
+        return m_data;
+      }
+
+      Byte* end() const {
+        return m_data + m_size;
+      }
+
+      Byte* data() const {
+        return m_data;
+      }
+
+      std::size_t size() const {
+        return m_size;
+      }
+
+
+    private:
+      Byte* m_data = nullptr;
+      std::size_t m_size = 0;
+      std::size_t m_mapped_size = 0;
+
+      void release() {
+        if( m_data )
+          munmap(m_data, m_mapped_size);
+      }
+  };
+
+
+  /** Use of huge pages by Aligned_allocator. */
+  enum class Huge_pages {
+    /** Blocks of normal pages. */
+    none,
+
+    /** Blocks of at least huge_page_size are aligned to huge pages and
+     * advised to use transparent huge pages. */
+    transparent,
+
+    /** Blocks are allocated from the reserved huge pages of the system
+     * (MAP_HUGETLB). Falls back to transparent huge pages if none are
+     * available. */
+    reserved
+  };
+
+
+  /** Allocator for Program_builder with page-aligned blocks of configurable
+   * size.
+   *
+   * Every block is a separate anonymous mapping, so it starts at a page
+   * boundary, as is needed for zero-copy DMA transfer. Large blocks can be
+   * backed by huge pages to reduce the number of TLB entries, and of
+   * scatter-gather entries, per program:
+   * @code
+   * uni::Aligned_allocator alloc(1 << 21, uni::Huge_pages::transparent);
+   * uni::Program_builder<uni::Aligned_allocator> bld(alloc);
+   * @endcode
+   * */
+  class Aligned_allocator {
+    public:
+      /** Size of huge pages, assumed to be that of x86-64. */
+      static std::size_t const huge_page_size = std::size_t(2) << 20;
+
+      /** Size of the blocks for Program_builder. */
+      std::size_t const block_size;
+
+      /** Use of huge pages for the blocks. */
+      Huge_pages const huge_pages;
+
+      /** Container type to use by Program_builder. */
+      typedef Aligned_block Container;
+
+      /** Iterator type to point to current insertion location by Program_builder. */
+      typedef Byte* Iterator;
+
+
+      /** @throws std::invalid_argument if block_size is smaller than the
+       * largest instruction. */
+      explicit Aligned_allocator(
+          std::size_t block_size = Byte_vector_allocator::default_block_size,
+          Huge_pages huge_pages = Huge_pages::none)
+        : block_size(detail::checked_block_size(block_size)),
+          huge_pages(huge_pages) {
+      }
+
+
+      /** Get Iterator to first byte in Container. */
+      Iterator begin(Container& c) {
+        return c.begin();
+      }
+
+      /** Get Iterator to last byte in Container. */
+      Iterator end(Container& c) {
+        return c.end();
+      }
+
+      /** Map a new block.
+       *
+       * @param capacity Size of container.
+       * @throws std::bad_alloc if the memory can not be mapped. */
+      Container allocate(size_t capacity) {
+#ifdef MAP_HUGETLB
+        if( huge_pages == Huge_pages::reserved ) {
+          std::size_t const mapped = round_up(capacity, huge_page_size);
+          void* const p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+          if( p != MAP_FAILED )
+            return Aligned_block(static_cast<Byte*>(p), capacity, mapped);
+        }
+#endif
+
+        if( (huge_pages != Huge_pages::none)
+            && (capacity >= huge_page_size) )
+          return map_huge_aligned(capacity);
+
+        std::size_t const mapped = round_up(capacity, sysconf(_SC_PAGESIZE));
+        return Aligned_block(map(mapped), capacity, mapped);
+      }
+
+
+    private:
+      static std::size_t round_up(std::size_t size, std::size_t align) {
+        return (size + align - 1) / align * align;
+      }
+
+      static Byte* map(std::size_t size) {
+        void* const p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if( p == MAP_FAILED )
+          throw std::bad_alloc();
+        return static_cast<Byte*>(p);
+      }
+
+      /** Map more than needed and unmap the parts before the first and
+       * after the last huge page. */
+      static Aligned_block map_huge_aligned(std::size_t capacity) {
+        std::size_t const mapped = round_up(capacity, huge_page_size);
+        Byte* const p = map(mapped + huge_page_size);
+
+        std::size_t const head = round_up(reinterpret_cast<uintptr_t>(p),
+            huge_page_size) - reinterpret_cast<uintptr_t>(p);
+        if( head > 0 )
+          munmap(p, head);
+        if( huge_page_size - head > 0 )
+          munmap(p + head + mapped, huge_page_size - head);
+
+#ifdef MADV_HUGEPAGE
+        madvise(p + head, mapped, MADV_HUGEPAGE);
+#endif
+        return Aligned_block(p + head, capacity, mapped);
+      }
+  };
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
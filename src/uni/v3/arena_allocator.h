@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "uni/v3/types.h"
+#include "uni/v3/program_builder.h"
+
+
+namespace uni {
+
+  /** Block of contiguous memory owned by an allocator, e.g.
+   * Arena_allocator. */
+  struct Block_view {
+    Byte* first = nullptr;
+    Byte* last = nullptr;
+
+    Block_view() {
+    }
+
+    Block_view(Byte* first, Byte* last)
+      : first(first), last(last) {
+    }
+
+    Byte* begin() const {
+      return first;
+    }
+
+    Byte* end() const {
+      return last;
+    }
+
+    Byte* data() const {
+      return first;
+    }
+
+    std::size_t size() const {
+      return last - first;
+    }
+  };
+
+
+  /** Allocator for Program_builder that keeps the whole program contiguous.
+   *
+   * Blocks are carved out one after the other from a range of virtual
+   * memory that is reserved at construction. The range is made accessible
+   * in steps of commit_size bytes as blocks are taken, and pages are only
+   * backed by memory when they are written. Program_builder pads every full
+   * block, and Program_builder::finish() the last one, so the contiguous
+   * span [data(), data() + size()) is a valid program that can be
+   * transferred or written to a file in one go, while the containers of the
+   * builder are views of the single blocks:
+   * @code
+   * uni::Arena_allocator arena;
+   * uni::Program_builder<uni::Arena_allocator> bld(arena);
+   * ...
+   * bld.halt();
+   * bld.finish();
+   * write(fd, arena.data(), arena.size());
+   * @endcode
+   *
+   * An arena is used by one builder at a time. reset() makes the memory
+   * available for the next program and invalidates all blocks.
+   * */
+  class Arena_allocator {
+    public:
+      static size_t const block_size =
+        Byte_vector_allocator::default_block_size;
+
+      /** Container type to use by Program_builder. */
+      typedef Block_view Container;
+
+      /** Iterator type to point to current insertion location by Program_builder. */
+      typedef Byte* Iterator;
+
+
+      /** Reserve the virtual memory for the arena.
+       *
+       * @param capacity Maximum size of all blocks, rounded up to whole
+       * pages.
+       * @param commit_size Size of the steps in which the memory is made
+       * accessible, rounded up to whole pages.
+       * */
+      explicit Arena_allocator(std::size_t capacity = std::size_t(1) << 34,
+          std::size_t commit_size = std::size_t(1) << 24) {
+        std::size_t const page = sysconf(_SC_PAGESIZE);
+        m_capacity = (capacity + page - 1) / page * page;
+        m_commit_size = (commit_size + page - 1) / page * page;
+
+        // no access and no commit charge until blocks are taken
+        void* const p = mmap(nullptr, m_capacity, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if( p == MAP_FAILED )
+          throw std::bad_alloc();
+        m_data = static_cast<Byte*>(p);
+      }
+
+      ~Arena_allocator() {
+        munmap(m_data, m_capacity);
+      }
+
+      Arena_allocator(Arena_allocator const&) = delete;
+      Arena_allocator& operator = (Arena_allocator const&) = delete;
+
+
+      /** Get Iterator to first byte in Container. */
+      Iterator begin(Container& c) {
+        return c.begin();
+      }
+
+      /** Get Iterator to last byte in Container. */
+      Iterator end(Container& c) {
+        return c.end();
+      }
+
+      /** Take the next block from the arena.
+       *
+       * @param capacity Size of container.
+       * @throws std::bad_alloc if the arena is exhausted or the memory can
+       * not be committed. */
+      Container allocate(size_t capacity) {
+        if( capacity > m_capacity - m_size )
+          throw std::bad_alloc();
+        if( m_size + capacity > m_committed )
+          commit(m_size + capacity);
+
+        Block_view const rv(m_data + m_size, m_data + m_size + capacity);
+        m_size += capacity;
+        return rv;
+      }
+
+
+      /** Beginning of the blocks. */
+      Byte* data() const {
+        return m_data;
+      }
+
+      /** Size of all blocks. */
+      std::size_t size() const {
+        return m_size;
+      }
+
+      /** Size of the reserved memory. */
+      std::size_t capacity() const {
+        return m_capacity;
+      }
+
+      /** Start again at the beginning of the arena.
+       *
+       * Invalidates all blocks. The memory stays committed and is not
+       * cleared, so the next program has to be finished with
+       * Program_builder::finish() to overwrite the end of the last block. */
+      void reset() {
+        m_size = 0;
+      }
+
+
+    private:
+      Byte* m_data = nullptr;
+      std::size_t m_size = 0;
+      std::size_t m_committed = 0;
+      std::size_t m_capacity = 0;
+      std::size_t m_commit_size = 0;
+
+
+      /** Make at least min_size bytes accessible. */
+      void commit(std::size_t min_size) {
+        std::size_t const new_size = std::min(m_capacity,
+            (min_size + m_commit_size - 1) / m_commit_size * m_commit_size);
+
+        if( mprotect(m_data + m_committed, new_size - m_committed,
+              PROT_READ | PROT_WRITE) != 0 )
+          throw std::bad_alloc();
+        m_committed = new_size;
+      }
+  };
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
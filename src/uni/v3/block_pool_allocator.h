@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "uni/v3/types.h"
+#include "uni/v3/program_builder.h"
+
+
+namespace uni {
+
+  /** Allocator for Program_builder that recycles blocks.
+   *
+   * Same blocks as Byte_vector_allocator, but blocks that are given back
+   * with recycle() are handed out again by allocate() instead of allocating
+   * new ones. Recycled blocks are not cleared, Program_builder overwrites
+   * them, except for the end of the last block, which Program_builder::
+   * finish() pads. The vectors that list the blocks of a program are
+   * recycled as well. When every finished program is recycled, e.g.
+   * @code
+   * uni::Block_pool_allocator pool;
+   * for(...) {
+   *   uni::Program_builder<uni::Block_pool_allocator> bld(pool,
+   *       pool.take_container_list());
+   *   ...
+   *   bld.halt();
+   *   bld.finish();
+   *   transfer(bld.containers);
+   *   pool.recycle(std::move(bld.containers));
+   * }
+   * @endcode
+   * the pool stops allocating once it holds as many blocks as the largest
+   * program needs, so building programs does not touch the heap anymore,
+   * unless the manifest of the builder is enabled.
+   *
+   * One pool can be shared by builders in several threads.
+   * */
+  class Block_pool_allocator {
+    public:
+      /** Size of the blocks for Program_builder. */
+      size_t const block_size;
+
+      /** Container type to use by Program_builder. */
+      typedef std::vector<Byte> Container;
+
+      /** Iterator type to point to current insertion location by Program_builder. */
+      typedef std::vector<Byte>::iterator Iterator;
+
+
+      /** @throws std::invalid_argument if block_size is smaller than the
+       * largest instruction. */
+      explicit Block_pool_allocator(
+          size_t block_size = Byte_vector_allocator::default_block_size)
+        : block_size(detail::checked_block_size(block_size)) {
+      }
+
+
+      /** Get Iterator to first byte in Container. */
+      Iterator begin(Container& c) {
+        return std::begin(c);
+      }
+
+      /** Get Iterator to last byte in Container. */
+      Iterator end(Container& c) {
+        return std::end(c);
+      }
+
+      /** Take a container from the pool or allocate a new one.
+       *
+       * @param capacity Size of container. */
+      Container allocate(size_t capacity) {
+        Container rv;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if( m_free.empty() ) {
+            ++m_num_allocated;
+          } else {
+            rv = std::move(m_free.back());
+            m_free.pop_back();
+          }
+        }
+
+        rv.resize(capacity);
+        return rv;
+      }
+
+      /** Give a container back to the pool. */
+      void recycle(Container&& c) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(std::move(c));
+      }
+
+      /** Give all containers of a program back to the pool and clear
+       * containers. */
+      void recycle(std::vector<Container>& containers) {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          for(auto& c : containers)
+            m_free.push_back(std::move(c));
+        }
+        containers.clear();
+      }
+
+      /** Give all containers of a program back to the pool, together with
+       * the vector itself for take_container_list(). */
+      void recycle(std::vector<Container>&& containers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto& c : containers)
+          m_free.push_back(std::move(c));
+        containers.clear();
+        m_lists.push_back(std::move(containers));
+      }
+
+      /** Take an empty vector that was given back with recycle(), to list
+       * the blocks of the next program without allocating, see
+       * Program_builder. Returns a new vector if there is none. */
+      std::vector<Container> take_container_list() {
+        std::vector<Container> rv;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if( !m_lists.empty() ) {
+          rv = std::move(m_lists.back());
+          m_lists.pop_back();
+        }
+        return rv;
+      }
+
+      /** Fill the pool up to num_blocks free blocks of block_size. */
+      void reserve(std::size_t num_blocks) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.reserve(num_blocks);
+        while( m_free.size() < num_blocks ) {
+          m_free.push_back(Container(block_size));
+          ++m_num_allocated;
+        }
+      }
+
+      /** Number of free blocks in the pool. */
+      std::size_t num_free() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_free.size();
+      }
+
+      /** Number of blocks the pool has allocated so far. */
+      std::size_t num_allocated() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_num_allocated;
+      }
+
+
+    private:
+      mutable std::mutex m_mutex;
+      std::vector<Container> m_free;
+      std::vector<std::vector<Container>> m_lists;
+      std::size_t m_num_allocated = 0;
+  };
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
@@ -1,13 +1,330 @@
 #pragma once
 
 #include <ostream>
+#include <type_traits>
+#include <utility>
 
 #include "uni/v3/instructions.h"
 #include "uni/v3/errors.h"
+#include "uni/v3/wait_for_7_scan.h"
 
 
 namespace uni {
 
+  namespace detail {
+
+    /** Whether Decoder declares static bool const raw_view = true. */
+    template<typename Decoder, typename Enable = void>
+    struct Wants_raw_view : std::false_type {
+    };
+
+    template<typename Decoder>
+    struct Wants_raw_view<Decoder,
+      typename std::enable_if<Decoder::raw_view>::type> : std::true_type {
+    };
+
+
+    /** Whether Decoder declares static bool const fire_one_runs = true. */
+    template<typename Decoder, typename Enable = void>
+    struct Wants_fire_one_runs : std::false_type {
+    };
+
+    template<typename Decoder>
+    struct Wants_fire_one_runs<Decoder,
+      typename std::enable_if<Decoder::fire_one_runs>::type> : std::true_type {
+    };
+
+
+    /** Whether Decoder declares static bool const wait_for_7_runs = true. */
+    template<typename Decoder, typename Enable = void>
+    struct Wants_wait_for_7_runs : std::false_type {
+    };
+
+    template<typename Decoder>
+    struct Wants_wait_for_7_runs<Decoder,
+      typename std::enable_if<Decoder::wait_for_7_runs>::type>
+      : std::true_type {
+    };
+
+
+    /** Instructions handled by Decoder, see decode(). */
+    template<typename Decoder, typename Enable = void>
+    struct Handled_instructions : Inst_mask<~0u> {
+    };
+
+    template<typename Decoder>
+    struct Handled_instructions<Decoder,
+      typename std::conditional<true, void,
+        typename Decoder::handled_instructions>::type>
+      : Inst_mask<Decoder::handled_instructions::mask> {
+    };
+
+
+    /** Instruction class that is passed to Decoder when decoding from It.
+     *
+     * This is Raw_view instead of Raw_inst for decoders that want views,
+     * if the byte-code is decoded through raw pointers. */
+    template<typename Inst, typename It, typename Decoder>
+    struct Decoded {
+      typedef Inst type;
+    };
+
+    template<typename Decoder>
+    struct Decoded<Raw_inst, Byte const*, Decoder> {
+      typedef typename std::conditional<Wants_raw_view<Decoder>::value,
+              Raw_view, Raw_inst>::type type;
+    };
+
+
+    template<typename It, typename Decoder, bool Checked, bool Runs>
+    struct Fire_one_handler;
+
+    template<typename It, typename Decoder, bool Checked, bool Runs>
+    struct Wait_for_7_handler;
+
+
+    /** Decoding functions for every instruction.
+     *
+     * Each handler checks that the instruction at a is complete, decodes it
+     * and passes it to dec. It returns the position after the instruction or
+     * a if the instruction is incomplete. Unchecked handlers trust the
+     * instruction to be complete. The skip_ handlers only advance over
+     * instructions that the decoder does not handle. */
+    template<typename It, typename Decoder, bool Checked>
+    struct Decode_handlers {
+      typedef It (*Handler)(It a, It b, Decoder& dec);
+
+      static It advance(It a, std::size_t n, std::true_type) {
+        return a + n;
+      }
+
+      static It advance(It a, std::size_t n, std::false_type) {
+        for(std::size_t i=0; i<n; ++i)
+          ++a;
+        return a;
+      }
+
+      /** Length of the instruction id at a. */
+      static std::size_t length(Inst_id id, It a) {
+        if( id != Inst_id::raw )
+          return inst_size(id);
+
+        ++a;
+        return inst_size(Inst_id::raw) + *a;
+      }
+
+#define UNI_X(name, classname, opcode, mask, size) \
+      static It name (It a, It b, Decoder& dec) { \
+        if( Checked && !check_ ## name (a, b) ) \
+          return a; \
+        typename Decoded<classname, It, Decoder>::type inst; \
+        It next = read_ ## name (a, inst); \
+        dec(inst); \
+        return next; \
+      } \
+      \
+      static It skip_ ## name (It a, It b, Decoder& /*dec*/) { \
+        if( Checked && !check_ ## name (a, b) ) \
+          return a; \
+        return advance(a, length(Inst_id::name, a), \
+            typename Is_random_access<It>::type()); \
+      }
+      UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+
+      static It unknown(It a, It /*b*/, Decoder& /*dec*/) {
+        throw Decode_error(__func__,
+            "unknonw",
+            static_cast<unsigned>(*a),
+            "encountered unknonw opcode");
+      }
+
+      static constexpr Handler handler(Byte b) {
+        if( !Opcodes<>::table.entries[b].valid )
+          return &unknown;
+
+        if( (Opcodes<>::table.entries[b].id == Inst_id::fire_one)
+            && Handled_instructions<Decoder>::contains(Inst_id::fire_one) )
+          return Fire_one_handler<It, Decoder, Checked,
+                 Wants_fire_one_runs<Decoder>::value
+                   && std::is_same<It, Byte const*>::value>::get();
+
+        if( (Opcodes<>::table.entries[b].id == Inst_id::wait_for_7)
+            && Handled_instructions<Decoder>::contains(Inst_id::wait_for_7) )
+          return Wait_for_7_handler<It, Decoder, Checked,
+                 Wants_wait_for_7_runs<Decoder>::value
+                   && std::is_same<It, Byte const*>::value>::get();
+
+        switch( Opcodes<>::table.entries[b].id ) {
+#define UNI_X(name, classname, opcode, mask, size) \
+          case Inst_id::name: \
+            return Handled_instructions<Decoder>::contains(Inst_id::name) \
+              ? &name : &skip_ ## name;
+          UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+        }
+        return &unknown;
+      }
+    };
+
+
+    /** Handler for FIRE_ONE instructions. */
+    template<typename It, typename Decoder, bool Checked, bool Runs>
+    struct Fire_one_handler {
+      typedef Decode_handlers<It, Decoder, Checked> Handlers;
+
+      static constexpr typename Handlers::Handler get() {
+        return &Handlers::fire_one;
+      }
+    };
+
+    /** Handler that passes runs of consecutive FIRE_ONE instructions as
+     * Fire_one_run to decoders that want them. */
+    template<typename Decoder, bool Checked>
+    struct Fire_one_handler<Byte const*, Decoder, Checked, true> {
+      typedef Decode_handlers<Byte const*, Decoder, Checked> Handlers;
+
+      static Byte const* run(Byte const* a, Byte const* b, Decoder& dec) {
+        std::ptrdiff_t const sz = inst_size(Inst_id::fire_one);
+
+        // complete instructions with the index byte set to zero
+        Byte const* p = a;
+        while( (b - p >= sz) && (p[0] == inst_opcode(Inst_id::fire_one))
+            && (p[sz - 1] == 0) )
+          p += sz;
+
+        // let the single instruction handler deal with errors
+        if( p == a )
+          return Handlers::fire_one(a, b, dec);
+
+        Fire_one_run inst;
+        inst.data = a;
+        inst.size = (p - a) / sz;
+        dec(inst);
+        return p;
+      }
+
+      static constexpr typename Handlers::Handler get() {
+        return &run;
+      }
+    };
+
+
+    /** Handler for WAIT_FOR_7 instructions. */
+    template<typename It, typename Decoder, bool Checked, bool Runs>
+    struct Wait_for_7_handler {
+      typedef Decode_handlers<It, Decoder, Checked> Handlers;
+
+      static constexpr typename Handlers::Handler get() {
+        return &Handlers::wait_for_7;
+      }
+    };
+
+    /** Handler that passes runs of consecutive WAIT_FOR_7 instructions as
+     * Wait_for_7_run to decoders that want them. */
+    template<typename Decoder, bool Checked>
+    struct Wait_for_7_handler<Byte const*, Decoder, Checked, true> {
+      typedef Decode_handlers<Byte const*, Decoder, Checked> Handlers;
+
+      static Byte const* run(Byte const* a, Byte const* b, Decoder& dec) {
+        Wait_for_7_run inst;
+        inst.t = 0;
+        Byte const* const p = scan_wait_for_7(a, b, inst.t);
+        inst.data = a;
+        inst.size = p - a;
+        dec(inst);
+        return p;
+      }
+
+      static constexpr typename Handlers::Handler get() {
+        return &run;
+      }
+    };
+
+
+    /** Table of handlers indexed by opcode byte, generated at compile time
+     * from the opcode table. */
+    template<typename It, typename Decoder, bool Checked>
+    struct Decode_table {
+      typedef Decode_handlers<It, Decoder, Checked> Handlers;
+      typedef typename Handlers::Handler Handler;
+
+      struct Table {
+        Handler entries[256];
+      };
+
+      template<std::size_t... B>
+      static constexpr Table make(std::index_sequence<B...>) {
+        return Table{{ Handlers::handler(B)... }};
+      }
+
+      static constexpr Table table = make(std::make_index_sequence<256>());
+    };
+
+    template<typename It, typename Decoder, bool Checked>
+    constexpr typename Decode_table<It, Decoder, Checked>::Table
+    Decode_table<It, Decoder, Checked>::table;
+
+
+    /** Decode instructions in [a, b) until a HALT instruction, which sets
+     * halted, or an incomplete instruction. */
+    template<bool Checked, typename It, typename Decoder>
+    It decode_loop(It a, It b, Decoder& dec, bool& halted) {
+      typedef Decode_table<It, Decoder, Checked> Table;
+
+      while( a != b ) {
+        Byte const op = *a;
+        It next = Table::table.entries[op](a, b, dec);
+
+        // incomplete instruction at the end of the buffer
+        if( Checked && (next == a) )
+          break;
+
+        a = next;
+        if( op == inst_opcode(Inst_id::halt) ) {
+          halted = true;
+          break;
+        }
+      }
+
+      return a;
+    }
+
+
+    template<bool Checked, typename It, typename Decoder>
+    It decode(It a, It b, Decoder& dec, std::false_type) {
+      bool halted = false;
+      return decode_loop<Checked>(a, b, dec, halted);
+    }
+
+    template<bool Checked, typename It, typename Decoder>
+    It decode(It a, It b, Decoder& dec, std::true_type) {
+      if( a == b )
+        return a;
+
+      bool halted = false;
+      Byte const* const begin = &*a;
+      Byte const* const end = begin + (b - a);
+      return a + (decode_loop<Checked>(begin, end, dec, halted) - begin);
+    }
+
+
+    /** Length of the instruction starting at p with n bytes available or 0
+     * if it is incomplete or p is no valid opcode. */
+    inline std::size_t inst_length(Byte const* p, std::size_t n) {
+      Opcode_info const& info = opcode_info(*p);
+      std::size_t len = info.size;
+      if( len == Opcode_info::variable_size ) {
+        if( !info.valid || (n < inst_size(Inst_id::raw)) )
+          return 0;
+        len = inst_size(Inst_id::raw) + p[1];
+      }
+      return (len <= n) ? len : 0;
+    }
+
+  }
+
+
   /** Decode a byte-code buffer using a special decoder.
    *
    * @tparam It InputIterator over the byte-code buffer.
@@ -30,67 +347,129 @@ namespace uni {
    * To decode spiketrains there is Spiketrain_decoder.
    * To extract RAW instructions there are Raw_extract_decoder and
    * Raw_reshape_decoder.
+   *
+   * Contiguous byte buffers, i.e. Byte pointers and std::vector<Byte>
+   * iterators, are decoded through raw pointers with single loads for
+   * multi-byte fields. Decoders that declare
+   *
+   *   static bool const raw_view = true;
+   *
+   * then receive RAW instructions as Raw_view pointing into the buffer
+   * instead of a Raw_inst with a copy of the data. For other iterators they
+   * still receive Raw_inst, so they need to handle both.
+   *
+   * In the same way, decoders that declare
+   *
+   *   static bool const fire_one_runs = true;
+   *
+   * receive runs of consecutive FIRE_ONE instructions as a single
+   * Fire_one_run, and decoders that declare
+   *
+   *   static bool const wait_for_7_runs = true;
+   *
+   * runs of WAIT_FOR_7 instructions as a single Wait_for_7_run with the
+   * accumulated time. The runs are found with SIMD instructions where
+   * available.
+   *
+   * Decoders that only need some instructions declare them with
+   *
+   *   typedef Inst_set<Read_inst, Write_inst> handled_instructions;
+   *
+   * Other instructions are then skipped by their length without being
+   * decoded or passed to the decoder. Skipped instructions are not checked
+   * for errors other than unknown opcodes.
    * */
   template<typename It, typename Decoder>
   It decode(It a, It b, Decoder& dec) {
-#define CASE_INST(opcode, classname, name) \
-  case opcode : \
-    { \
-      if( check_ ## name (a, b) ) { \
-        classname inst; \
-        a = read_ ## name (a, inst); \
-        dec(inst); \
-      } else \
-        end_of_program = true; \
-    } \
-    break
+    return detail::decode<true>(a, b, dec,
+        typename detail::Is_contiguous_bytes<It>::type());
+  }
 
-    bool end_of_program = false;
 
-    while( !end_of_program && (a != b) ) {
-      if( *a & 0x80 ) {
-        Wait_for_7_inst inst;
-        a = read_wait_for_7(a, inst);
-        dec(inst);
-      } else {
-        switch( *a ) {
-          CASE_INST(0x00, Set_time_inst, set_time);
-          CASE_INST(0x01, Wait_until_inst, wait_until);
-          CASE_INST(0x02, Raw_inst, raw);
-          CASE_INST(0x04, Wait_for_16_inst, wait_for_16);
-          CASE_INST(0x05, Wait_for_32_inst, wait_for_32);
-          CASE_INST(0x0a, Write_inst, write);
-          CASE_INST(0x0b, Read_inst, read);
-          CASE_INST(0x0c, Rec_start_inst, rec_start);
-          CASE_INST(0x0d, Rec_stop_inst, rec_stop);
-          CASE_INST(0x0f, Fire_one_or_madc_inst, fire_one);
-
-          case 0x0e:
-            {
-              Halt_inst inst;
-              a = read_halt(a, inst);
-              dec(inst);
-              end_of_program = true;
-            }
-            break;
-
-          default:
-            throw Decode_error(__func__,
-                "unknonw",
-                static_cast<unsigned>(*a),
-                "encountered unknonw opcode");
-        }
+  /** Result of validate(). */
+  struct Validation {
+    /** Offset past the last complete instruction. */
+    std::size_t end = 0;
+
+    /** Number of complete instructions before end. */
+    std::size_t count = 0;
+
+    /** There is an unknown opcode at offset end. */
+    bool bad_opcode = false;
+
+    /** The last instruction before end is a HALT. */
+    bool halted = false;
+  };
+
+
+  /** Check that a byte-code buffer consists of complete instructions.
+   *
+   * @param a Beginning of byte-code.
+   * @param b Past the end of byte-code.
+   * @returns Extent of the complete instructions.
+   *
+   * Walks the buffer by instruction lengths only, without decoding. It stops
+   * after a HALT instruction, at an unknown opcode, or at an instruction that
+   * is cut off by b. The range [a, a + end) can then be decoded with
+   * decode_unchecked().
+   * */
+  inline Validation validate(Byte const* a, Byte const* b) {
+    Validation rv;
+    Byte const* p = a;
+
+    while( p != b ) {
+      std::size_t const len = detail::inst_length(p, b - p);
+      if( len == 0 ) {
+        rv.bad_opcode = !opcode_info(*p).valid;
+        break;
+      }
+
+      ++rv.count;
+      if( *p == inst_opcode(Inst_id::halt) ) {
+        rv.halted = true;
+        p += len;
+        break;
       }
+      p += len;
     }
 
-    return a;
+    rv.end = p - a;
+    return rv;
+  }
+
+
+  /** Validate a std::vector<Byte> or other contiguous buffer, see
+   * validate(Byte const*, Byte const*). */
+  template<typename It>
+  typename std::enable_if<detail::Is_contiguous_bytes<It>::value, Validation>::type
+  validate(It a, It b) {
+    if( a == b )
+      return Validation();
+    return validate(static_cast<Byte const*>(&*a), &*a + (b - a));
+  }
+
 
-#undef CASE_INST
+  /** Decode a byte-code buffer without bounds checks.
+   *
+   * Same as decode() but instructions are trusted to be complete, so the
+   * range has to be validated before, e.g. by validate():
+   * @code
+   * auto const v = uni::validate(buf.begin(), buf.end());
+   * uni::decode_unchecked(buf.begin(), buf.begin() + v.end, dec);
+   * @endcode
+   * Unknown opcodes are still reported by Decode_error.
+   * */
+  template<typename It, typename Decoder>
+  It decode_unchecked(It a, It b, Decoder& dec) {
+    return detail::decode<false>(a, b, dec,
+        typename detail::Is_contiguous_bytes<It>::type());
   }
 
 
   /** Print programs from byte-code using decode() */
   struct Stream_decoder {
+    static bool const raw_view = true;
+
     Stream_decoder(std::ostream& os)
       : os(os) {
     }
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "uni/v3/instructions.h"
+#include "uni/v3/decoder.h"
+
+
+namespace uni {
+
+  namespace detail {
+
+    template<bool... B>
+    struct Any_of : std::false_type {
+    };
+
+    template<bool B0, bool... B>
+    struct Any_of<B0, B...>
+      : std::integral_constant<bool, B0 || Any_of<B...>::value> {
+    };
+
+    /** Whether Decoder receives RAW instructions as Raw_inst from
+     * Fan_out_decoder, i.e. handles them but does not want views. */
+    template<typename Decoder>
+    struct Wants_raw_copy : std::integral_constant<bool,
+      !Wants_raw_view<Decoder>::value
+      && Handled_instructions<Decoder>::contains(Inst_id::raw)> {
+    };
+
+    template<uint32_t... Masks>
+    constexpr uint32_t mask_union() {
+      uint32_t const masks[] = { 0u, Masks... };
+
+      uint32_t rv = 0;
+      for(auto m : masks)
+        rv |= m;
+      return rv;
+    }
+
+  }
+
+
+  /** Pass every decoded instruction to several decoders.
+   *
+   * @tparam Decoders Types of the decoders to combine.
+   *
+   * Use together with decode() to run several decoders over a buffer in a
+   * single pass, e.g.:
+   * @code
+   * uni::Standard_spiketrain_and_madc_decoder spikes;
+   * uni::Rw_extract_decoder rw;
+   * uni::Raw_extract_decoder raw;
+   * auto dec = uni::fan_out(spikes, rw, raw);
+   * uni::decode(buf.begin(), buf.end(), dec);
+   * @endcode
+   *
+   * The decoders are held by reference and receive the instructions in the
+   * order they are given. If any of them wants Raw_view, the fan-out
+   * decoder does so as well and the others that handle RAW receive a single
+   * copy as Raw_inst, which is only made if there are such decoders. Runs
+   * of FIRE_ONE and WAIT_FOR_7 instructions are treated the same way, see
+   * Fire_one_run and Wait_for_7_run. Instructions that none of the decoders
+   * handle are skipped, see decode(). The others are passed to all
+   * decoders, which ignore instructions they do not handle with a generic
+   * operator ().
+   * */
+  template<typename... Decoders>
+  class Fan_out_decoder {
+    public:
+      static bool const raw_view =
+        detail::Any_of<detail::Wants_raw_view<Decoders>::value...>::value;
+
+      /** Whether RAW payloads are copied for decoders without views. */
+      static bool const raw_copy =
+        detail::Any_of<detail::Wants_raw_copy<Decoders>::value...>::value;
+
+      static bool const fire_one_runs =
+        detail::Any_of<detail::Wants_fire_one_runs<Decoders>::value...>::value;
+
+      static bool const wait_for_7_runs =
+        detail::Any_of<
+          detail::Wants_wait_for_7_runs<Decoders>::value...>::value;
+
+      typedef Inst_mask<detail::mask_union<
+        detail::Handled_instructions<Decoders>::mask...>()>
+        handled_instructions;
+
+
+      explicit Fan_out_decoder(Decoders&... decs)
+        : m_decs(decs...) {
+      }
+
+
+      template<typename T> void operator () (T const& inst) {
+        for_each([&inst](auto& dec) {
+            dec(inst);
+          });
+      }
+
+      void operator () (Raw_view const& inst) {
+        Raw_inst copy;
+        if( raw_copy )
+          copy.data.assign(inst.begin(), inst.end());
+
+        for_each([&inst, &copy](auto& dec) {
+            typedef typename std::decay<decltype(dec)>::type Decoder;
+            deliver(dec, inst, copy, detail::Wants_raw_view<Decoder>(),
+                detail::Wants_raw_copy<Decoder>());
+          });
+      }
+
+
+      void operator () (Fire_one_run const& inst) {
+        for_each([&inst](auto& dec) {
+            deliver(dec, inst, detail::Wants_fire_one_runs<
+              typename std::decay<decltype(dec)>::type>());
+          });
+      }
+
+
+      void operator () (Wait_for_7_run const& inst) {
+        for_each([&inst](auto& dec) {
+            deliver(dec, inst, detail::Wants_wait_for_7_runs<
+              typename std::decay<decltype(dec)>::type>());
+          });
+      }
+
+
+      /** The combined decoders. */
+      std::tuple<Decoders&...> const& decoders() const {
+        return m_decs;
+      }
+
+
+    private:
+      std::tuple<Decoders&...> m_decs;
+
+
+      template<typename F>
+      void for_each(F f) {
+        for_each(f, std::index_sequence_for<Decoders...>());
+      }
+
+      template<typename F, std::size_t... I>
+      void for_each(F f, std::index_sequence<I...>) {
+        int dummy[] = { 0, (f(std::get<I>(m_decs)), 0)... };
+        static_cast<void>(dummy);
+      }
+
+
+      template<typename Decoder, typename Copy>
+      static void deliver(Decoder& dec, Raw_view const& inst,
+          Raw_inst const& /*copy*/, std::true_type, Copy) {
+        dec(inst);
+      }
+
+      template<typename Decoder>
+      static void deliver(Decoder& dec, Raw_view const& /*inst*/,
+          Raw_inst const& copy, std::false_type, std::true_type) {
+        dec(copy);
+      }
+
+      /** Decoders that ignore RAW do not receive it at all. */
+      template<typename Decoder>
+      static void deliver(Decoder& /*dec*/, Raw_view const& /*inst*/,
+          Raw_inst const& /*copy*/, std::false_type, std::false_type) {
+      }
+
+      template<typename Decoder, typename Run>
+      static void deliver(Decoder& dec, Run const& inst, std::true_type) {
+        dec(inst);
+      }
+
+      template<typename Decoder, typename Run>
+      static void deliver(Decoder& dec, Run const& inst, std::false_type) {
+        for(std::size_t i=0; i<inst.size; ++i)
+          dec(inst[i]);
+      }
+  };
+
+
+  /** Combine decoders into a Fan_out_decoder. */
+  template<typename... Decoders>
+  Fan_out_decoder<Decoders...> fan_out(Decoders&... decs) {
+    return Fan_out_decoder<Decoders...>(decs...);
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
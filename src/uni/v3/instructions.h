@@ -1,7 +1,10 @@
 #pragma once
 
 #include <bitset>
+#include <cstring>
+#include <iterator>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "uni/v3/types.h"
@@ -11,18 +14,143 @@
 namespace uni {
 
 
+  namespace detail {
+
+    /** Whether the distance between two It can be computed in O(1). */
+    template<typename It, typename Enable = void>
+    struct Is_random_access : std::false_type {
+    };
+
+    template<typename It>
+    struct Is_random_access<It,
+      typename std::enable_if<std::is_base_of<
+        std::random_access_iterator_tag,
+        typename std::iterator_traits<It>::iterator_category>::value>::type>
+      : std::true_type {
+    };
+
+
+    /** Whether It points into contiguous memory of Bytes. Multi-byte
+     * fields are then accessed with a single load or store. */
+    template<typename It>
+    struct Is_contiguous_bytes : std::false_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<Byte*> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<Byte const*> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<std::vector<Byte>::iterator> : std::true_type {
+    };
+
+    template<>
+    struct Is_contiguous_bytes<std::vector<Byte>::const_iterator>
+      : std::true_type {
+    };
+
+
+    /** Unsigned integer with N bytes. */
+    template<std::size_t N>
+    struct Uint_of_size;
+
+    template<>
+    struct Uint_of_size<1> {
+      typedef uint8_t type;
+    };
+
+    template<>
+    struct Uint_of_size<2> {
+      typedef uint16_t type;
+    };
+
+    template<>
+    struct Uint_of_size<4> {
+      typedef uint32_t type;
+    };
+
+    template<>
+    struct Uint_of_size<8> {
+      typedef uint64_t type;
+    };
+
+
+    inline uint8_t big_endian_uint(uint8_t v) {
+      return v;
+    }
+
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    inline uint16_t big_endian_uint(uint16_t v) {
+      return __builtin_bswap16(v);
+    }
+
+    inline uint32_t big_endian_uint(uint32_t v) {
+      return __builtin_bswap32(v);
+    }
+
+    inline uint64_t big_endian_uint(uint64_t v) {
+      return __builtin_bswap64(v);
+    }
+#else
+    template<typename T>
+    T big_endian_uint(T v) {
+      Byte bytes[sizeof(T)];
+      for(std::size_t i=0; i<sizeof(T); i++)
+        bytes[i] = v >> ((sizeof(T) - i - 1) * 8);
+
+      T rv;
+      std::memcpy(&rv, bytes, sizeof(T));
+      return rv;
+    }
+#endif
+
+    /** Convert between host and big-endian (byte-code) byte order.
+     *
+     * Works on any integer type by its size, e.g. int and unsigned long
+     * long, which are not among the fixed-width types on every platform. */
+    template<typename T>
+    T big_endian(T v) {
+      typedef typename Uint_of_size<sizeof(T)>::type Uint;
+      return static_cast<T>(big_endian_uint(static_cast<Uint>(v)));
+    }
+
+
+    template<typename InOutIterator, typename T>
+    InOutIterator fill_data(InOutIterator it, T w, std::false_type) {
+      for(std::size_t i=0; i<sizeof(T); i++) {
+        T b = (w >> ((sizeof(T) - i - 1) * 8));
+        *it = b & 0xff;
+        ++it;
+      }
+      return it;
+    }
+
+    template<typename InOutIterator, typename T>
+    InOutIterator fill_data(InOutIterator it, T w, std::true_type) {
+      T const be = big_endian(w);
+      std::memcpy(&*it, &be, sizeof(T));
+      return it + sizeof(T);
+    }
+
+  }
+
+
   //---------------------------------------------------------------------------
   // Instruction coding
   //---------------------------------------------------------------------------
 
+  /** Write w in big-endian byte order.
+   *
+   * For contiguous byte buffers (see detail::Is_contiguous_bytes) this is a
+   * single byte-swapped store. */
   template<typename InOutIterator, typename T>
   InOutIterator fill_data(InOutIterator it, T w) {
-    for(std::size_t i=0; i<sizeof(T); i++) {
-      T b = (w >> ((sizeof(T) - i - 1) * 8));
-      *it = b & 0xff;
-      ++it;
-    }
-    return it;
+    return detail::fill_data(it, w,
+        typename detail::Is_contiguous_bytes<InOutIterator>::type());
   }
 
 #define FILL_INST_0(name) \
@@ -132,38 +260,187 @@ namespace uni {
   // Instruction classes
   //---------------------------------------------------------------------------
 
+  /** Description of all UNI instructions.
+   *
+   * X(name, classname, opcode, mask, size) is expanded for every instruction
+   * to generate the instruction tables. A byte b is the opcode of the
+   * instruction if (b & mask) == opcode. size is the length of the byte-code
+   * of the instruction in bytes, for RAW it is the length of the header
+   * (opcode and number of data bytes) only. */
+#define UNI_INSTRUCTIONS(X) \
+  X(set_time, Set_time_inst, 0x00, 0xff, 1 + sizeof(Time)) \
+  X(wait_until, Wait_until_inst, 0x01, 0xff, 1 + sizeof(Time)) \
+  X(raw, Raw_inst, 0x02, 0xff, 2) \
+  X(wait_for_16, Wait_for_16_inst, 0x04, 0xff, 1 + sizeof(uint16_t)) \
+  X(wait_for_32, Wait_for_32_inst, 0x05, 0xff, 1 + sizeof(uint32_t)) \
+  X(write, Write_inst, 0x0a, 0xff, 1 + sizeof(Address) + sizeof(Word)) \
+  X(read, Read_inst, 0x0b, 0xff, 1 + sizeof(Address)) \
+  X(rec_start, Rec_start_inst, 0x0c, 0xff, 1) \
+  X(rec_stop, Rec_stop_inst, 0x0d, 0xff, 1) \
+  X(halt, Halt_inst, 0x0e, 0xff, 1) \
+  X(fire_one, Fire_one_or_madc_inst, 0x0f, 0xff, \
+      1 + sizeof(uint64_t) + sizeof(uint8_t)) \
+  X(wait_for_7, Wait_for_7_inst, 0x80, 0x80, 1)
+
+
+  /** Identifiers of UNI instructions.
+   *
+   * Each Instruction carries its identifier instead of a name string, the
+   * name for pretty printing is looked up in a compile-time table by
+   * inst_name(). */
+  enum class Inst_id : uint8_t {
+#define UNI_X(name, classname, opcode, mask, size) name,
+    UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+  };
+
+
+  /** Number of instructions, i.e. of values of Inst_id. */
+  static std::size_t const num_inst_ids = 0
+#define UNI_X(name, classname, opcode, mask, size) + 1
+    UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+    ;
+
+
+  /** Name of the instruction identified by id. */
+  inline char const* inst_name(Inst_id id) {
+    static char const* const names[] = {
+#define UNI_X(name, classname, opcode, mask, size) #name,
+      UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+    };
+    return names[static_cast<std::size_t>(id)];
+  }
+
+
+  /** Size of the byte-code of instruction id in bytes.
+   *
+   * RAW instructions have variable length, for them only the size of the
+   * header (opcode and length byte) is returned. */
+  constexpr std::size_t inst_size(Inst_id id) {
+    switch( id ) {
+#define UNI_X(name, classname, opcode, mask, size) \
+      case Inst_id::name: return size;
+      UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+    }
+    return 0;
+  }
+
+
+  /** Opcode of instruction id, see also inst_opcode_mask(). */
+  constexpr Byte inst_opcode(Inst_id id) {
+    switch( id ) {
+#define UNI_X(name, classname, opcode, mask, size) \
+      case Inst_id::name: return opcode;
+      UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+    }
+    return 0;
+  }
+
+
+  /** Bits of a byte that form the opcode of instruction id. The remaining
+   * bits carry arguments, e.g. the time for WAIT_FOR_7. */
+  constexpr Byte inst_opcode_mask(Inst_id id) {
+    switch( id ) {
+#define UNI_X(name, classname, opcode, mask, size) \
+      case Inst_id::name: return mask;
+      UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+    }
+    return 0;
+  }
+
+
+  /** Entry of the opcode table, see opcode_info(). */
+  struct Opcode_info {
+    /** Byte is the opcode of an instruction. */
+    bool valid;
+
+    /** Instruction identified by the opcode. */
+    Inst_id id;
+
+    /** Length of the instruction in bytes or variable_size for RAW. */
+    uint8_t size;
+
+    /** Marker for instructions whose length is encoded in the byte-code. */
+    static uint8_t const variable_size = 0;
+  };
+
+
+  namespace detail {
+
+    struct Opcode_table {
+      Opcode_info entries[256];
+    };
+
+    constexpr Opcode_table make_opcode_table() {
+      Opcode_table rv {};
+      for(unsigned b=0; b<256; ++b) {
+        rv.entries[b] = Opcode_info{false, Inst_id::halt, 0};
+#define UNI_X(name, classname, opcode, mask, size) \
+        if( (b & mask) == opcode ) \
+          rv.entries[b] = Opcode_info{true, Inst_id::name, \
+            (Inst_id::name == Inst_id::raw) \
+              ? Opcode_info::variable_size \
+              : static_cast<uint8_t>(size)};
+        UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+      }
+      return rv;
+    }
+
+    /** Holder to have one definition of the table across translation
+     * units. */
+    template<typename Dummy = void>
+    struct Opcodes {
+      static constexpr Opcode_table table = make_opcode_table();
+    };
+
+    template<typename Dummy>
+    constexpr Opcode_table Opcodes<Dummy>::table;
+
+  }
+
+
+  /** Look up instruction and length for an opcode byte.
+   *
+   * The 256-entry table is generated at compile time from
+   * UNI_INSTRUCTIONS. */
+  inline Opcode_info const& opcode_info(Byte b) {
+    return detail::Opcodes<>::table.entries[b];
+  }
+
+
   /** Base class for UNI instructions.
    *
    * The derived classes of Instruction constitute the internal representation
    * of UNI instructions. The read_ functions implement decoding of these
    * instructions into buffers.
+   *
+   * Instructions are plain values without dynamic memory (except for the
+   * payload of Raw_inst), so decode() can construct them for every opcode
+   * at no cost.
    * */
   struct Instruction {
     /** Maximum length of names for pretty printing. */
     static int const name_width = 15;
 
-    /** Name of instruction. */
-    std::string const name;
+    /** Identifier of instruction. */
+    Inst_id id;
 
-    /** Construct named instruction.
+    /** Construct identified instruction.
      *
-     * @param name Name of the instruction. */
-    explicit Instruction(std::string const& name)
-      : name(name) {
+     * @param id Identifier of the instruction. */
+    explicit Instruction(Inst_id id)
+      : id(id) {
     }
 
-#if __cplusplus >= 201103L
-	/** Implictly-declared copy constructor needs to be explicitly
-	 * default-declared. */
-	Instruction(Instruction const&) = default;
-#endif
-
-    /** No-op assignment operator to allow for automatic deduction of
-     * assignment operators for derived classes.
-     * FIXME (ECM@2016-12-23): This is very unexpected behavior... we shall fix this.
-     */
-    Instruction const& operator=(Instruction const& /*other*/) {
-      return *this;
+    /** Name of instruction. */
+    char const* name() const {
+      return inst_name(id);
     }
   };
 
@@ -173,22 +450,22 @@ namespace uni {
     /** Time argument for this instruction. */
     Time t;
 
-    Timing_inst(std::string const& name)
-      : Instruction(name) {
+    explicit Timing_inst(Inst_id id)
+      : Instruction(id) {
     }
   };
 
 
   struct Set_time_inst : public Timing_inst {
     Set_time_inst()
-      : Timing_inst("set_time") {
+      : Timing_inst(Inst_id::set_time) {
     }
   };
 
 
   struct Wait_until_inst : public Timing_inst {
     Wait_until_inst()
-      : Timing_inst("wait_until") {
+      : Timing_inst(Inst_id::wait_until) {
     }
   };
 
@@ -197,7 +474,7 @@ namespace uni {
     Address address;
 
     Read_inst()
-      : Instruction("read") {
+      : Instruction(Inst_id::read) {
     }
   };
 
@@ -206,31 +483,55 @@ namespace uni {
     Word data;
 
     Write_inst()
-      : Instruction("write") {
+      : Instruction(Inst_id::write) {
     }
   };
 
   struct Halt_inst : public Instruction {
     Halt_inst()
-      : Instruction("halt") {
+      : Instruction(Inst_id::halt) {
     }
   };
 
   struct Wait_for_7_inst : public Timing_inst {
     Wait_for_7_inst()
-      : Timing_inst("wait_for_7") {
+      : Timing_inst(Inst_id::wait_for_7) {
+    }
+  };
+
+  /** Run of consecutive WAIT_FOR_7 instructions in the decoded buffer.
+   *
+   * Delivered instead of single Wait_for_7_inst to decoders that declare
+   *
+   *   static bool const wait_for_7_runs = true;
+   *
+   * when decoding contiguous byte buffers, see decode(). t is the sum of the
+   * times of all instructions of the run. */
+  struct Wait_for_7_run : public Timing_inst {
+    Byte const* data = nullptr;     /**< Byte-code of the first instruction. */
+    std::size_t size = 0;           /**< Number of instructions. */
+
+    Wait_for_7_run()
+      : Timing_inst(Inst_id::wait_for_7) {
+    }
+
+    /** The i-th instruction of the run. */
+    Wait_for_7_inst operator [] (std::size_t i) const {
+      Wait_for_7_inst inst;
+      inst.t = data[i] & 0x7f;
+      return inst;
     }
   };
 
   struct Wait_for_16_inst : public Timing_inst {
     Wait_for_16_inst()
-      : Timing_inst("wait_for_16") {
+      : Timing_inst(Inst_id::wait_for_16) {
     }
   };
 
   struct Wait_for_32_inst : public Timing_inst {
     Wait_for_32_inst()
-      : Timing_inst("wait_for_32") {
+      : Timing_inst(Inst_id::wait_for_32) {
     }
   };
 
@@ -238,7 +539,7 @@ namespace uni {
     std::vector<Byte> data;
 
     Raw_inst()
-      : Instruction("raw") {
+      : Instruction(Inst_id::raw) {
     }
 
     bool operator == (Raw_inst const& other) const {
@@ -247,15 +548,49 @@ namespace uni {
     }
   };
 
+  /** RAW instruction that refers to its data in the decoded buffer.
+   *
+   * Delivered instead of Raw_inst to decoders that declare
+   *
+   *   static bool const raw_view = true;
+   *
+   * when decoding contiguous byte buffers, see decode(). No memory is
+   * allocated for the data, which is only valid as long as the decoded
+   * buffer is. */
+  struct Raw_view : public Instruction {
+    Byte const* data = nullptr;
+    std::size_t size = 0;
+
+    Raw_view()
+      : Instruction(Inst_id::raw) {
+    }
+
+    Raw_view(Byte const* data, std::size_t size)
+      : Instruction(Inst_id::raw), data(data), size(size) {
+    }
+
+    explicit Raw_view(Raw_inst const& inst)
+      : Raw_view(inst.data.data(), inst.data.size()) {
+    }
+
+    Byte const* begin() const {
+      return data;
+    }
+
+    Byte const* end() const {
+      return data + size;
+    }
+  };
+
   struct Rec_start_inst : public Instruction {
     Rec_start_inst()
-      : Instruction("rec_start") {
+      : Instruction(Inst_id::rec_start) {
     }
   };
 
   struct Rec_stop_inst : public Instruction {
     Rec_stop_inst()
-      : Instruction("rec_stop") {
+      : Instruction(Inst_id::rec_stop) {
     }
   };
 
@@ -265,11 +600,108 @@ namespace uni {
     uint32_t payload;
 
     Fire_one_or_madc_inst()
-      : Instruction("fire_one") {
+      : Instruction(Inst_id::fire_one) {
+    }
+  };
+
+
+  /** Run of consecutive FIRE_ONE instructions in the decoded buffer.
+   *
+   * Delivered instead of single Fire_one_or_madc_inst to decoders that
+   * declare
+   *
+   *   static bool const fire_one_runs = true;
+   *
+   * when decoding contiguous byte buffers, see decode(). There are no timing
+   * instructions between the instructions of a run, so they all have the
+   * same time. Like Raw_view it is only valid as long as the decoded buffer
+   * is. */
+  struct Fire_one_run : public Instruction {
+    Byte const* data = nullptr;     /**< Byte-code of the first instruction. */
+    std::size_t size = 0;           /**< Number of instructions. */
+
+    Fire_one_run()
+      : Instruction(Inst_id::fire_one) {
+    }
+
+    /** Decode the i-th instruction of the run. */
+    Fire_one_or_madc_inst operator [] (std::size_t i) const;
+  };
+
+
+  /** Compile-time properties of instruction classes.
+   *
+   * Inst_traits<T>::id identifies the instruction that T represents. */
+  template<typename Inst>
+  struct Inst_traits;
+
+#define UNI_X(name, classname, opcode, mask, size) \
+  template<> \
+  struct Inst_traits<classname> { \
+    static constexpr Inst_id id = Inst_id::name; \
+  };
+  UNI_INSTRUCTIONS(UNI_X)
+#undef UNI_X
+
+  template<>
+  struct Inst_traits<Raw_view> {
+    static constexpr Inst_id id = Inst_id::raw;
+  };
+
+  template<>
+  struct Inst_traits<Wait_for_7_run> {
+    static constexpr Inst_id id = Inst_id::wait_for_7;
+  };
+
+  template<>
+  struct Inst_traits<Fire_one_run> {
+    static constexpr Inst_id id = Inst_id::fire_one;
+  };
+
+
+  /** Set of instructions given as a bit mask of Inst_id. */
+  template<uint32_t Mask>
+  struct Inst_mask {
+    static constexpr uint32_t mask = Mask;
+
+    static constexpr bool contains(Inst_id id) {
+      return (Mask >> static_cast<unsigned>(id)) & 1;
     }
   };
 
 
+  namespace detail {
+
+    template<typename... Insts>
+    constexpr uint32_t inst_mask() {
+      uint32_t const bits[] = { 0u,
+        (1u << static_cast<unsigned>(Inst_traits<Insts>::id))... };
+
+      uint32_t rv = 0;
+      for(auto b : bits)
+        rv |= b;
+      return rv;
+    }
+
+  }
+
+
+  /** Set of instructions given by their classes, e.g.
+   * Inst_set<Read_inst, Write_inst>. */
+  template<typename... Insts>
+  struct Inst_set : Inst_mask<detail::inst_mask<Insts...>()> {
+  };
+
+
+  static_assert(std::is_trivially_copyable<Write_inst>::value
+      && std::is_trivially_copyable<Wait_for_7_inst>::value
+      && std::is_trivially_copyable<Fire_one_or_madc_inst>::value
+      && std::is_trivially_copyable<Raw_view>::value
+      && std::is_trivially_copyable<Fire_one_run>::value
+      && std::is_trivially_copyable<Wait_for_7_run>::value,
+      "Instructions are supposed to be plain values");
+
+
   //---------------------------------------------------------------------------
   // Output operators
   //---------------------------------------------------------------------------
@@ -277,7 +709,7 @@ namespace uni {
 
   inline std::ostream& operator << (std::ostream& os, Instruction const& inst) {
     return os << std::setfill(' ') << std::setw(inst.name_width)
-      << inst.name;
+      << inst.name();
   }
 
   inline std::ostream& operator << (std::ostream& os, Timing_inst const& inst) {
@@ -313,19 +745,23 @@ namespace uni {
     return os << strm.str();
   }
 
-  inline std::ostream& operator << (std::ostream& os, Raw_inst const& inst) {
+  inline std::ostream& operator << (std::ostream& os, Raw_view const& inst) {
     std::stringstream strm;
 
     strm << static_cast<Instruction>(inst)
-      << " x" << inst.data.size()
+      << " x" << inst.size
       << " { ";
-    for(auto const& d : inst.data)
+    for(auto const& d : inst)
       strm << std::hex << std::setfill('0') << std::setw(2)
         << +d << ' ';
     strm << "}";
     return os << strm.str();
   }
 
+  inline std::ostream& operator << (std::ostream& os, Raw_inst const& inst) {
+    return os << Raw_view(inst);
+  }
+
   inline std::ostream& operator << (std::ostream& os, Fire_one_or_madc_inst const& inst) {
     std::stringstream strm;
 
@@ -339,67 +775,114 @@ namespace uni {
   // Instruction decoding
   //---------------------------------------------------------------------------
 
+  namespace detail {
+
+    template<typename InputIt, typename T>
+    InputIt read_data(InputIt it, T& data, std::false_type) {
+      data = 0;
+      for(std::size_t i=0; i<sizeof(T); i++) {
+        std::size_t byte_i = sizeof(T) - i - 1;
+        data |= static_cast<T>(*it) << (byte_i * 8);
+        ++it;
+      }
+      return it;
+    }
+
+    template<typename InputIt, typename T>
+    InputIt read_data(InputIt it, T& data, std::true_type) {
+      T be;
+      std::memcpy(&be, &*it, sizeof(T));
+      data = big_endian(be);
+      return it + sizeof(T);
+    }
+
+
+    template<typename InputIt>
+    InputIt read_bytes(InputIt it, std::size_t sz, std::vector<Byte>& data,
+        std::false_type) {
+      data.reserve(sz);
+      for(size_t i=0; i<sz; ++i) {
+        data.push_back(*it);
+        ++it;
+      }
+      return it;
+    }
+
+    template<typename InputIt>
+    InputIt read_bytes(InputIt it, std::size_t sz, std::vector<Byte>& data,
+        std::true_type) {
+      data.assign(it, it + sz);
+      return it + sz;
+    }
+
+  }
+
+
+  /** Read big-endian data.
+   *
+   * For contiguous byte buffers (see detail::Is_contiguous_bytes) this is a
+   * single unaligned load followed by a byte swap. */
   template<typename InputIt, typename T>
   InputIt read_data(InputIt it, T& data) {
-    data = 0;
-    for(std::size_t i=0; i<sizeof(T); i++) {
-      std::size_t byte_i = sizeof(T) - i - 1;
-      data |= static_cast<T>(*it) << (byte_i * 8);
-      ++it;
-    }
-    return it;
+    return detail::read_data(it, data,
+        typename detail::Is_contiguous_bytes<InputIt>::type());
   }
 
 
-#define READ_INST(name, classname, opcode, body) \
+#define READ_INST(name, classname, body) \
   template<typename InputIt> \
   InputIt read_ ## name (InputIt it, classname & inst) { \
-    if( *it != opcode ) \
+    if( *it != inst_opcode(Inst_id::name) ) \
       throw Decode_error(__func__, #name, *it, "wrong opcode for " #name ); \
     body \
   }
 
 
-  READ_INST(set_time, Set_time_inst, 0x00, return read_data(++it, inst.t);)
-  READ_INST(wait_until, Wait_until_inst, 0x01, return read_data(++it, inst.t);)
-  READ_INST(write, Write_inst, 0x0a,
+  READ_INST(set_time, Set_time_inst, return read_data(++it, inst.t);)
+  READ_INST(wait_until, Wait_until_inst, return read_data(++it, inst.t);)
+  READ_INST(write, Write_inst,
       it = read_data(++it, inst.address);
       return read_data(it, inst.data);)
-  READ_INST(read, Read_inst, 0x0b,
+  READ_INST(read, Read_inst,
       return read_data(++it, inst.address);)
-  READ_INST(halt, Halt_inst, 0x0e,
+  READ_INST(halt, Halt_inst,
       static_cast<void>(inst);
       return ++it;)
 
-  READ_INST(wait_for_16, Wait_for_16_inst, 0x04,
+  READ_INST(wait_for_16, Wait_for_16_inst,
       uint16_t tmp;
       it = read_data(++it, tmp);
       inst.t = tmp;
       return it;)
-  READ_INST(wait_for_32, Wait_for_32_inst, 0x05,
+  READ_INST(wait_for_32, Wait_for_32_inst,
       uint32_t tmp;
       it = read_data(++it, tmp);
       inst.t = tmp;
       return it;)
-  READ_INST(rec_start, Rec_start_inst, 0x0c,
+  READ_INST(rec_start, Rec_start_inst,
       static_cast<void>(inst);
       return ++it;)
-  READ_INST(rec_stop, Rec_stop_inst, 0x0d,
+  READ_INST(rec_stop, Rec_stop_inst,
       static_cast<void>(inst);
       return ++it;)
-  READ_INST(raw, Raw_inst, 0x02,
+  READ_INST(raw, Raw_inst,
       ++it;
       uint8_t sz = *it;
       ++it;
-      inst.data.reserve(sz);
-      for(size_t i=0; i<sz; ++i) {
-        inst.data.push_back(*it);
-        ++it;
-      }
-      return it;)
+      return detail::read_bytes(it, sz, inst.data,
+        typename detail::Is_contiguous_bytes<InputIt>::type());)
+
+  /** Read a RAW instruction without copying its data. */
+  inline Byte const* read_raw(Byte const* it, Raw_view& inst) {
+    if( *it != inst_opcode(Inst_id::raw) )
+      throw Decode_error(__func__, "raw", *it, "wrong opcode for raw");
+    inst.size = it[1];
+    inst.data = it + inst_size(Inst_id::raw);
+    return inst.data + inst.size;
+  }
 // The following implementation differs from the original definition of the
 // fire_one opcode. This is a work around of #2468.
-  READ_INST(fire_one, Fire_one_or_madc_inst, 0x0f,
+  READ_INST(fire_one, Fire_one_or_madc_inst,
       uint64_t tmp;
       it = read_data(++it, tmp);
       inst.key = (tmp >> 30) & 0x3; // 2 MSB decode if spike or number of samples
@@ -431,38 +914,71 @@ namespace uni {
 #undef READ_INST
 
 
-#define CHECK_INST(name, sz) \
+  inline Fire_one_or_madc_inst Fire_one_run::operator [] (std::size_t i) const {
+    Fire_one_or_madc_inst inst;
+    read_fire_one(data + i * inst_size(Inst_id::fire_one), inst);
+    return inst;
+  }
+
+
+  namespace detail {
+
+    template<typename InputIt>
+    bool check_size(InputIt a, InputIt stop, std::size_t sz, std::true_type) {
+      return stop - a >= static_cast<std::ptrdiff_t>(sz);
+    }
+
+    template<typename InputIt>
+    bool check_size(InputIt a, InputIt stop, std::size_t sz, std::false_type) {
+      for(size_t i=0; i<sz; ++i) {
+        if( a == stop )
+          return false;
+        ++a;
+      }
+      return true;
+    }
+
+  }
+
+
+  /** Check if there are at least sz bytes between a and stop.
+   *
+   * This is a single comparison for random-access iterators, other
+   * iterators are advanced up to sz times. */
+  template<typename InputIt>
+  bool check_size(InputIt a, InputIt stop, std::size_t sz) {
+    return detail::check_size(a, stop, sz,
+        typename detail::Is_random_access<InputIt>::type());
+  }
+
+
+#define CHECK_INST(name) \
   template<typename InputIt> \
   bool check_ ## name (InputIt a, InputIt stop) { \
-    for(size_t i=0; i< sz ; ++i) \
-      if( ++a == stop ) \
-        return false; \
-    return true; \
-  }
-
-  CHECK_INST(set_time, 1 + sizeof(Time))
-  CHECK_INST(wait_until, 1 + sizeof(Time))
-  CHECK_INST(write, 1 + sizeof(Address) + sizeof(Word))
-  CHECK_INST(read, 1 + sizeof(Word))
-  CHECK_INST(halt, 1)
-  CHECK_INST(wait_for_16, 1 + sizeof(uint16_t))
-  CHECK_INST(wait_for_32, 1 + sizeof(uint32_t))
-  CHECK_INST(rec_start, 1)
-  CHECK_INST(rec_stop, 1)
-  CHECK_INST(wait_for_7, 1)
-  CHECK_INST(fire_one, 1 + sizeof(uint64_t) + sizeof(uint8_t))
+    return check_size(a, stop, inst_size(Inst_id::name)); \
+  }
+
+  CHECK_INST(set_time)
+  CHECK_INST(wait_until)
+  CHECK_INST(write)
+  CHECK_INST(read)
+  CHECK_INST(halt)
+  CHECK_INST(wait_for_16)
+  CHECK_INST(wait_for_32)
+  CHECK_INST(rec_start)
+  CHECK_INST(rec_stop)
+  CHECK_INST(wait_for_7)
+  CHECK_INST(fire_one)
 
   template<typename InputIt>
   bool check_raw(InputIt a, InputIt stop) {
-    if( ++a == stop )
+    if( !check_size(a, stop, inst_size(Inst_id::raw)) )
       return false;
 
+    ++a;
     uint8_t sz = *a;
-    for(size_t i=0; i<sz; ++i)
-      if( ++a == stop )
-        return false;
-
-    return true;
+    ++a;
+    return check_size(a, stop, sz);
   }
 
 #undef CHECK_INST
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "uni/v3/instructions.h"
+
+
+namespace uni {
+
+  namespace detail {
+
+    /** Key and payload of the FIRE_ONE instruction at p, i.e. the low 32
+     * bits of its data field. */
+    inline uint32_t fire_one_word(Byte const* p) {
+      uint32_t be;
+      std::memcpy(&be, p + 1 + sizeof(uint64_t) - sizeof(uint32_t), sizeof(be));
+      return big_endian(be);
+    }
+
+
+#if defined(__AVX2__)
+    /** Number of instructions unpacked by unpack_madc_block(). */
+    static std::size_t const madc_block_size = 8;
+
+    /** Unpack a block of FIRE_ONE instructions at p that all carry three MADC
+     * samples. Writes one sample more than it unpacks.
+     *
+     * @returns false without writing if any key is not 3. */
+    inline bool unpack_madc_block(Byte const* p, uint16_t* out) {
+      std::size_t const sz = inst_size(Inst_id::fire_one);
+      __m256i const v = _mm256_set_epi32(
+          fire_one_word(p + 7 * sz), fire_one_word(p + 6 * sz),
+          fire_one_word(p + 5 * sz), fire_one_word(p + 4 * sz),
+          fire_one_word(p + 3 * sz), fire_one_word(p + 2 * sz),
+          fire_one_word(p + sz), fire_one_word(p));
+
+      __m256i const keys = _mm256_srli_epi32(v, 30);
+      if( _mm256_movemask_epi8(_mm256_cmpeq_epi32(keys, _mm256_set1_epi32(3)))
+          != -1 )
+        return false;
+
+      // per instruction sample_0 | sample_1 << 16 and sample_2
+      __m256i const m = _mm256_set1_epi32(0x3ff);
+      __m256i const lo = _mm256_or_si256(_mm256_and_si256(v, m),
+          _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 10), m), 16));
+      __m256i const hi = _mm256_and_si256(_mm256_srli_epi32(v, 20), m);
+
+      // 64 bit words with the three samples of instructions 0, 1 | 4, 5 and
+      // 2, 3 | 6, 7
+      __m256i const w0145 = _mm256_unpacklo_epi32(lo, hi);
+      __m256i const w2367 = _mm256_unpackhi_epi32(lo, hi);
+      __m128i const w01 = _mm256_castsi256_si128(w0145);
+      __m128i const w23 = _mm256_castsi256_si128(w2367);
+      __m128i const w45 = _mm256_extracti128_si256(w0145, 1);
+      __m128i const w67 = _mm256_extracti128_si256(w2367, 1);
+
+      // overlapping stores, each overwrites the fourth slot of the previous
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out), w01);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3), _mm_srli_si128(w01, 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 6), w23);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 9), _mm_srli_si128(w23, 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 12), w45);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 15), _mm_srli_si128(w45, 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 18), w67);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 21), _mm_srli_si128(w67, 8));
+      return true;
+    }
+#elif defined(__SSE2__)
+    static std::size_t const madc_block_size = 4;
+
+    inline bool unpack_madc_block(Byte const* p, uint16_t* out) {
+      std::size_t const sz = inst_size(Inst_id::fire_one);
+      __m128i const v = _mm_set_epi32(
+          fire_one_word(p + 3 * sz), fire_one_word(p + 2 * sz),
+          fire_one_word(p + sz), fire_one_word(p));
+
+      __m128i const keys = _mm_srli_epi32(v, 30);
+      if( _mm_movemask_epi8(_mm_cmpeq_epi32(keys, _mm_set1_epi32(3)))
+          != 0xffff )
+        return false;
+
+      __m128i const m = _mm_set1_epi32(0x3ff);
+      __m128i const lo = _mm_or_si128(_mm_and_si128(v, m),
+          _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 10), m), 16));
+      __m128i const hi = _mm_and_si128(_mm_srli_epi32(v, 20), m);
+
+      __m128i const w01 = _mm_unpacklo_epi32(lo, hi);
+      __m128i const w23 = _mm_unpackhi_epi32(lo, hi);
+
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out), w01);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3), _mm_srli_si128(w01, 8));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 6), w23);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 9), _mm_srli_si128(w23, 8));
+      return true;
+    }
+#else
+    static std::size_t const madc_block_size = 0;
+
+    inline bool unpack_madc_block(Byte const* /*p*/, uint16_t* /*out*/) {
+      return false;
+    }
+#endif
+
+  }
+
+
+  /** Unpack the MADC samples of a run of FIRE_ONE instructions.
+   *
+   * @param run Instructions to unpack.
+   * @param out Array with room for 3 * run.size + 1 samples, regardless of
+   * how many samples the run holds.
+   * @param spike Called with the event address of spikes in the run.
+   * @returns Past the last unpacked sample.
+   *
+   * Blocks of instructions with three samples each are unpacked with AVX2
+   * or SSE2, depending on the target architecture, everything else one
+   * instruction at a time. Every instruction stores three samples and
+   * advances by the number it holds, so up to two samples after the
+   * returned position may be overwritten.
+   * */
+  template<typename Spike_fn>
+  uint16_t* unpack_madc(Fire_one_run const& run, uint16_t* out,
+      Spike_fn spike) {
+    std::size_t const sz = inst_size(Inst_id::fire_one);
+    std::size_t const block = detail::madc_block_size;
+    Byte const* p = run.data;
+    std::size_t i = 0;
+
+    while( i < run.size ) {
+      std::size_t n = 1;
+      if( (block > 0) && (run.size - i >= block) ) {
+        if( detail::unpack_madc_block(p, out) ) {
+          out += 3 * block;
+          p += block * sz;
+          i += block;
+          continue;
+        }
+        n = block;
+      }
+
+      for(std::size_t k=0; k<n; ++k, p += sz) {
+        uint32_t const w = detail::fire_one_word(p);
+        unsigned const key = w >> 30;
+        if( key == 0 ) {
+          spike(static_cast<Event_address>(~w & 0xff));
+          continue;
+        }
+
+        out[0] = w & 0x3ff;
+        out[1] = (w >> 10) & 0x3ff;
+        out[2] = (w >> 20) & 0x3ff;
+        out += key;
+      }
+      i += n;
+    }
+
+    return out;
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "uni/v3/types.h"
+#include "uni/v3/program_builder.h"
+#include "uni/v3/arena_allocator.h"
+
+
+namespace uni {
+
+  namespace detail {
+
+    inline std::system_error errno_error(char const* what) {
+      return std::system_error(errno, std::generic_category(), what);
+    }
+
+  }
+
+
+  /** Allocator for Program_builder that writes the program to a file.
+   *
+   * Like Arena_allocator, blocks are carved out one after the other from a
+   * reserved range of virtual memory, but the range is backed by a file
+   * that grows in steps of grow_size bytes. Encoding writes straight into
+   * the page cache and the kernel writes the pages back to the file, so
+   * programs do not need to fit into memory. After close() the file holds
+   * the concatenated blocks and can be decoded with Mapped_program:
+   * @code
+   * {
+   *   uni::Mapped_file_allocator file("stimulus.uni");
+   *   uni::Program_builder<uni::Mapped_file_allocator> bld(file);
+   *   ...
+   * }
+   * uni::Mapped_program program("stimulus.uni");
+   * uni::decode(program.begin(), program.end(), dec);
+   * @endcode
+   *
+   * Errors of the file operations are reported as std::system_error.
+   * */
+  class Mapped_file_allocator {
+    public:
+      static size_t const block_size =
+        Byte_vector_allocator::default_block_size;
+
+      /** Container type to use by Program_builder. */
+      typedef Block_view Container;
+
+      /** Iterator type to point to current insertion location by Program_builder. */
+      typedef Byte* Iterator;
+
+
+      /** Create or truncate the file at path.
+       *
+       * @param path File to write the program to.
+       * @param capacity Maximum size of the program, rounded up to whole
+       * pages.
+       * @param grow_size Size of the steps in which the file grows, rounded
+       * up to whole pages.
+       * */
+      explicit Mapped_file_allocator(std::string const& path,
+          std::size_t capacity = std::size_t(1) << 40,
+          std::size_t grow_size = std::size_t(1) << 24) {
+        std::size_t const page = sysconf(_SC_PAGESIZE);
+        m_capacity = (capacity + page - 1) / page * page;
+        m_grow_size = (grow_size + page - 1) / page * page;
+
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if( m_fd < 0 )
+          throw detail::errno_error("open");
+
+        void* const p = mmap(nullptr, m_capacity, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if( p == MAP_FAILED ) {
+          ::close(m_fd);
+          throw std::bad_alloc();
+        }
+        m_data = static_cast<Byte*>(p);
+      }
+
+      ~Mapped_file_allocator() {
+        try {
+          close();
+        } catch(...) {
+        }
+      }
+
+      Mapped_file_allocator(Mapped_file_allocator const&) = delete;
+      Mapped_file_allocator& operator = (Mapped_file_allocator const&) = delete;
+
+
+      /** Get Iterator to first byte in Container. */
+      Iterator begin(Container& c) {
+        return c.begin();
+      }
+
+      /** Get Iterator to last byte in Container. */
+      Iterator end(Container& c) {
+        return c.end();
+      }
+
+      /** Take the next block from the file, growing it if necessary.
+       *
+       * @param capacity Size of container.
+       * @throws std::bad_alloc if the capacity is exhausted. */
+      Container allocate(size_t capacity) {
+        if( capacity > m_capacity - m_size )
+          throw std::bad_alloc();
+        if( m_size + capacity > m_mapped )
+          grow(m_size + capacity);
+
+        Block_view const rv(m_data + m_size, m_data + m_size + capacity);
+        m_size += capacity;
+        return rv;
+      }
+
+
+      /** Beginning of the blocks. */
+      Byte* data() const {
+        return m_data;
+      }
+
+      /** Size of all blocks. */
+      std::size_t size() const {
+        return m_size;
+      }
+
+      /** Write the blocks to the file and wait for completion. */
+      void sync() {
+        if( (m_size > 0) && (msync(m_data, m_size, MS_SYNC) != 0) )
+          throw detail::errno_error("msync");
+      }
+
+      /** Truncate the file to the size of the blocks and close it.
+       *
+       * Invalidates all blocks. Called by the destructor, which ignores
+       * errors. */
+      void close() {
+        if( m_fd < 0 )
+          return;
+
+        munmap(m_data, m_capacity);
+        m_data = nullptr;
+        int const rv = ftruncate(m_fd, m_size);
+        int const err = errno;
+        ::close(m_fd);
+        m_fd = -1;
+        if( rv != 0 ) {
+          errno = err;
+          throw detail::errno_error("ftruncate");
+        }
+      }
+
+
+    private:
+      int m_fd = -1;
+      Byte* m_data = nullptr;
+      std::size_t m_size = 0;
+      std::size_t m_mapped = 0;
+      std::size_t m_written = 0;   /**< Size written back by grow(). */
+      std::size_t m_capacity = 0;
+      std::size_t m_grow_size = 0;
+
+
+      /** Grow the file and its mapping to at least min_size bytes. */
+      void grow(std::size_t min_size) {
+        std::size_t const new_size = std::min(m_capacity,
+            (min_size + m_grow_size - 1) / m_grow_size * m_grow_size);
+
+        if( ftruncate(m_fd, new_size) != 0 )
+          throw detail::errno_error("ftruncate");
+
+        void* const p = mmap(m_data + m_mapped, new_size - m_mapped,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_fd, m_mapped);
+        if( p == MAP_FAILED )
+          throw detail::errno_error("mmap");
+
+#ifdef SYNC_FILE_RANGE_WRITE
+        // start writing back the blocks taken since the last step, so dirty
+        // pages do not pile up in memory
+        if( m_size > m_written )
+          sync_file_range(m_fd, m_written, m_size - m_written,
+              SYNC_FILE_RANGE_WRITE);
+        m_written = m_size;
+#endif
+
+        m_mapped = new_size;
+      }
+  };
+
+
+  /** Read-only mapping of a program file, e.g. from Mapped_file_allocator.
+   *
+   * The bytes are decoded straight from the page cache:
+   * @code
+   * uni::Mapped_program program(path);
+   * uni::decode(program.begin(), program.end(), dec);
+   * @endcode
+   * */
+  class Mapped_program {
+    public:
+      /** Map the file at path.
+       *
+       * @throws std::system_error if the file can not be mapped. */
+      explicit Mapped_program(std::string const& path) {
+        int const fd = ::open(path.c_str(), O_RDONLY);
+        if( fd < 0 )
+          throw detail::errno_error("open");
+
+        struct stat st;
+        if( fstat(fd, &st) != 0 ) {
+          int const err = errno;
+          ::close(fd);
+          errno = err;
+          throw detail::errno_error("fstat");
+        }
+
+        m_size = st.st_size;
+        if( m_size > 0 ) {
+          void* const p = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+          int const err = errno;
+          ::close(fd);
+          if( p == MAP_FAILED ) {
+            errno = err;
+            throw detail::errno_error("mmap");
+          }
+          m_data = static_cast<Byte const*>(p);
+          madvise(const_cast<Byte*>(m_data), m_size, MADV_SEQUENTIAL);
+        } else {
+          ::close(fd);
+        }
+      }
+
+      ~Mapped_program() {
+        if( m_data )
+          munmap(const_cast<Byte*>(m_data), m_size);
+      }
+
+      Mapped_program(Mapped_program const&) = delete;
+      Mapped_program& operator = (Mapped_program const&) = delete;
+
+
+      Byte const* begin() const {
+        return m_data;
+      }
+
+      Byte const* end() const {
+        return m_data + m_size;
+      }
+
+      Byte const* data() const {
+        return m_data;
+      }
+
+      std::size_t size() const {
+        return m_size;
+      }
+
+
+    private:
+      Byte const* m_data = nullptr;
+      std::size_t m_size = 0;
+  };
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
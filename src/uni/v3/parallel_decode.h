@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "uni/v3/instructions.h"
+#include "uni/v3/decoder.h"
+#include "uni/v3/program_builder.h"
+#include "uni/v3/time_scan.h"
+
+
+namespace uni {
+
+  namespace detail {
+
+    inline std::size_t default_num_threads(std::size_t num_threads) {
+      if( num_threads > 0 )
+        return num_threads;
+      return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+
+    /** Indices left to a worker of parallel_for(). */
+    struct Work_range {
+      std::mutex mutex;
+      std::size_t begin = 0;
+      std::size_t end = 0;
+    };
+
+
+    /** Take the next index of the own range. */
+    inline bool take_work(Work_range& own, std::size_t& i) {
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if( own.begin == own.end )
+        return false;
+      i = own.begin++;
+      return true;
+    }
+
+    /** Move the upper half of the range of another worker to the own, empty
+     * range. */
+    inline bool steal_work(std::vector<Work_range>& ranges, std::size_t self) {
+      for(std::size_t k=1; k<ranges.size(); ++k) {
+        Work_range& victim = ranges[(self + k) % ranges.size()];
+        std::size_t begin, end;
+        {
+          std::lock_guard<std::mutex> lock(victim.mutex);
+          if( victim.begin == victim.end )
+            continue;
+          begin = victim.begin + (victim.end - victim.begin) / 2;
+          end = victim.end;
+          victim.end = begin;
+        }
+
+        std::lock_guard<std::mutex> lock(ranges[self].mutex);
+        ranges[self].begin = begin;
+        ranges[self].end = end;
+        return true;
+      }
+      return false;
+    }
+
+
+    /** Give every worker an equal share of the indices [0, n). */
+    inline void share_work(std::vector<Work_range>& ranges, std::size_t n) {
+      std::size_t const workers = ranges.size();
+      for(std::size_t w=0; w<workers; ++w) {
+        ranges[w].begin = n * w / workers;
+        ranges[w].end = n * (w + 1) / workers;
+      }
+    }
+
+    /** Call f(i) for the own indices of worker self, then for stolen ones,
+     * and keep the exceptions by index. */
+    template<typename F>
+    void do_work(std::vector<Work_range>& ranges,
+        std::vector<std::exception_ptr>& errors, std::size_t self, F& f) {
+      std::size_t i;
+      while( take_work(ranges[self], i) || (steal_work(ranges, self)
+            && take_work(ranges[self], i)) ) {
+        try {
+          f(i);
+        } catch(...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    }
+
+    /** Rethrow the exception for the lowest index, if any. */
+    inline void rethrow_first(std::vector<std::exception_ptr> const& errors) {
+      for(auto const& e : errors)
+        if( e )
+          std::rethrow_exception(e);
+    }
+
+
+    /** Call f(i) for i in [0, n) on num_threads threads.
+     *
+     * Every thread starts with an equal share of the indices and takes them
+     * in order. Threads that run out of work steal the upper half of the
+     * remaining indices of another thread, so uneven work is balanced.
+     * Exceptions are rethrown in the calling thread, the one for the lowest
+     * i first. The threads are started for every call, see Worker_pool to
+     * reuse them. */
+    template<typename F>
+    void parallel_for(std::size_t n, std::size_t num_threads, F f) {
+      std::size_t const workers = std::max<std::size_t>(1,
+          std::min(num_threads, n));
+      std::vector<Work_range> ranges(workers);
+      share_work(ranges, n);
+      std::vector<std::exception_ptr> errors(n);
+
+      auto work = [&](std::size_t self) {
+        do_work(ranges, errors, self, f);
+      };
+
+      std::vector<std::thread> threads;
+      for(std::size_t w=1; w<workers; ++w)
+        threads.emplace_back(work, w);
+      work(0);
+      for(auto& th : threads)
+        th.join();
+
+      rethrow_first(errors);
+    }
+
+  }
+
+
+  /** Threads that are kept for many calls of parallel functions, e.g.
+   * batch_decode().
+   *
+   * Starting threads takes in the order of tens of microseconds each, which
+   * can outweigh decoding when small inputs are decoded over and over
+   * again. A pool starts its threads once and wakes them for every call:
+   * @code
+   * uni::Worker_pool pool;
+   * while(...) {
+   *   auto decs = uni::batch_decode(buffers.begin(), buffers.end(), make,
+   *       pool);
+   *   ...
+   * }
+   * @endcode
+   *
+   * The calling thread works as one of the threads. Calls from several
+   * threads are carried out one after the other.
+   * */
+  class Worker_pool {
+    public:
+      /** Start the threads.
+       *
+       * @param num_threads Number of threads including the calling one, 0
+       * for one per core. */
+      explicit Worker_pool(std::size_t num_threads = 0)
+        : m_size(detail::default_num_threads(num_threads)) {
+        try {
+          for(std::size_t w=1; w<m_size; ++w)
+            m_threads.emplace_back(&Worker_pool::loop, this, w);
+        } catch(...) {
+          stop();
+          throw;
+        }
+      }
+
+      ~Worker_pool() {
+        stop();
+      }
+
+      Worker_pool(Worker_pool const&) = delete;
+      Worker_pool& operator = (Worker_pool const&) = delete;
+
+
+      /** Number of threads including the calling one. */
+      std::size_t size() const {
+        return m_size;
+      }
+
+      /** Call f(i) for i in [0, n) on the threads of the pool.
+       *
+       * Balances work and reports exceptions like detail::parallel_for(). */
+      template<typename F>
+      void parallel_for(std::size_t n, F f) {
+        std::lock_guard<std::mutex> call_lock(m_call_mutex);
+
+        std::vector<detail::Work_range> ranges(
+            std::max<std::size_t>(1, std::min(m_size, n)));
+        detail::share_work(ranges, n);
+        std::vector<std::exception_ptr> errors(n);
+
+        std::function<void(std::size_t)> const job =
+          [&](std::size_t self) {
+            if( self < ranges.size() )
+              detail::do_work(ranges, errors, self, f);
+          };
+
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_job = &job;
+          m_pending = m_threads.size();
+          ++m_generation;
+        }
+        m_start.notify_all();
+
+        job(0);
+
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_done.wait(lock, [this]{ return m_pending == 0; });
+          m_job = nullptr;
+        }
+
+        detail::rethrow_first(errors);
+      }
+
+
+    private:
+      std::size_t const m_size;
+      std::vector<std::thread> m_threads;
+
+      /** Serializes calls of parallel_for(). */
+      std::mutex m_call_mutex;
+
+      std::mutex m_mutex;
+      std::condition_variable m_start;
+      std::condition_variable m_done;
+      std::function<void(std::size_t)> const* m_job = nullptr;
+      std::size_t m_generation = 0;
+      std::size_t m_pending = 0;
+      bool m_stop = false;
+
+
+      void loop(std::size_t self) {
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while( true ) {
+          m_start.wait(lock, [&]{ return m_stop || (m_generation != seen); });
+          if( m_stop )
+            return;
+          seen = m_generation;
+
+          std::function<void(std::size_t)> const* const job = m_job;
+          lock.unlock();
+          (*job)(self);
+          lock.lock();
+
+          if( --m_pending == 0 )
+            m_done.notify_all();
+        }
+      }
+
+      void stop() {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_stop = true;
+        }
+        m_start.notify_all();
+        for(auto& th : m_threads)
+          th.join();
+        m_threads.clear();
+      }
+  };
+
+
+  /** Split a program into pieces of at most chunk_size bytes.
+   *
+   * @param a Beginning of byte-code.
+   * @param b Past the end of byte-code.
+   * @param chunk_size Maximum size of the pieces. A piece ends with the last
+   * instruction that fits, so pieces are usually a little smaller. Sizes
+   * below the maximum instruction size are raised to it.
+   * @returns Offset and time of the first instruction of every piece.
+   *
+   * Walks the program by instruction lengths like summarize_time(), so it
+   * works for any program but is sequential. Programs built with
+   * Program_builder can be split in parallel with block_split_points().
+   * */
+  inline std::vector<Split_point> split_points(Byte const* a, Byte const* b,
+      std::size_t chunk_size) {
+    chunk_size = std::max<std::size_t>(chunk_size, 2 + 255);
+
+    std::vector<Split_point> rv;
+    Split_point cur;
+    while( true ) {
+      rv.push_back(cur);
+
+      Byte const* const p = a + cur.offset;
+      Time_summary const s = summarize_time(p,
+          p + std::min<std::size_t>(chunk_size, b - p));
+      if( s.halted || (s.end == 0) || (p + s.end == b) )
+        break;
+
+      cur = Split_point(cur.offset + s.end, s.apply(cur.t));
+    }
+    return rv;
+  }
+
+
+  /** Split a program built with Program_builder at its blocks.
+   *
+   * @param a Beginning of the concatenated blocks.
+   * @param b Past the end of the blocks.
+   * @param block_size Size of the blocks, e.g. the block_size of the
+   * allocator.
+   * @param num_threads Number of threads to use, 0 for one per core.
+   * @returns Offset and time of the start of every block up to the one with
+   * the HALT instruction.
+   *
+   * Program_builder pads blocks with WAIT_FOR_7 instructions, so every block
+   * starts with an instruction. The time of every block is summarized in
+   * parallel and the summaries are combined into the start times.
+   * */
+  inline std::vector<Split_point> block_split_points(Byte const* a,
+      Byte const* b, std::size_t block_size, std::size_t num_threads = 0) {
+    std::size_t const n = (b - a + block_size - 1) / block_size;
+    std::vector<Time_summary> summaries(n);
+
+    detail::parallel_for(n, detail::default_num_threads(num_threads),
+        [&](std::size_t i) {
+          Byte const* const p = a + i * block_size;
+          summaries[i] = summarize_time(p,
+              p + std::min<std::size_t>(block_size, b - p));
+        });
+
+    std::vector<Split_point> rv;
+    Time t = 0;
+    for(std::size_t i=0; i<n; ++i) {
+      rv.emplace_back(i * block_size, t);
+      if( summaries[i].halted )
+        break;
+      t = summaries[i].apply(t);
+    }
+    return rv;
+  }
+
+
+  /** Split a program at its blocks with the manifest of Program_builder.
+   *
+   * Same as block_split_points() without scanning the program. */
+  inline std::vector<Split_point> manifest_split_points(
+      std::vector<Block_info> const& manifest) {
+    std::vector<Split_point> rv;
+    for(auto const& block : manifest)
+      rv.emplace_back(block.offset, block.start_t);
+    return rv;
+  }
+
+
+  /** Decode the pieces of a program in parallel.
+   *
+   * @tparam Decoder Type to use for decoding of byte-code, has to be default
+   * constructible.
+   *
+   * @param a Beginning of byte-code.
+   * @param b Past the end of byte-code.
+   * @param splits Pieces to decode, e.g. from split_points() or
+   * block_split_points().
+   * @param num_threads Number of threads to use, 0 for one per core.
+   * @returns One decoder per piece, in the order of the pieces.
+   *
+   * Every piece is decoded with its own decoder. Except for the first, each
+   * decoder first receives a Set_time_inst with the time at the start of its
+   * piece, so time tracking decoders produce the same times as decode().
+   * Results in time order are obtained by concatenating the results of the
+   * decoders in the returned order.
+   *
+   * Decode_error is rethrown in the calling thread, the one of the first
+   * piece if several pieces fail.
+   * */
+  template<typename Decoder>
+  std::vector<Decoder> parallel_decode(Byte const* a, Byte const* b,
+      std::vector<Split_point> const& splits, std::size_t num_threads = 0) {
+    std::vector<Decoder> rv(splits.size());
+
+    detail::parallel_for(splits.size(), detail::default_num_threads(num_threads),
+        [&](std::size_t i) {
+          Byte const* const p = a + splits[i].offset;
+          Byte const* const q = (i + 1 < splits.size())
+            ? a + splits[i + 1].offset : b;
+
+          if( i > 0 ) {
+            Set_time_inst start;
+            start.t = splits[i].t;
+            rv[i](start);
+          }
+          decode(p, q, rv[i]);
+        });
+
+    return rv;
+  }
+
+
+  namespace detail {
+
+    /** Type of the decoders made by Factory. */
+    template<typename Factory>
+    using Decoder_of = typename std::decay<
+      decltype(std::declval<Factory&>()())>::type;
+
+    template<typename It, typename Factory, typename Parallel_for>
+    std::vector<Decoder_of<Factory>> batch_decode(It first, It last,
+        Factory& make_decoder, Parallel_for parallel_for) {
+      std::vector<It> buffers;
+      std::vector<Decoder_of<Factory>> rv;
+      for(; first != last; ++first) {
+        buffers.push_back(first);
+        rv.push_back(make_decoder());
+      }
+
+      parallel_for(buffers.size(), [&](std::size_t i) {
+          decode(std::begin(*buffers[i]), std::end(*buffers[i]), rv[i]);
+        });
+
+      return rv;
+    }
+
+  }
+
+
+  /** Decode many independent programs in parallel.
+   *
+   * @param first Iterator to the first buffer, e.g. a std::vector<Byte>.
+   * @param last Iterator past the last buffer.
+   * @param make_decoder Called without arguments to create the decoder for
+   * every buffer.
+   * @param num_threads Number of threads to use, 0 for one per core.
+   * @returns One decoder per buffer, in the order of the buffers.
+   *
+   * The decoders are created in the calling thread in the order of the
+   * buffers, so make_decoder does not need to be thread safe. Then the
+   * buffers are decoded on a pool of threads that steal work from each
+   * other, so buffers of very different sizes keep all threads busy. The
+   * result does not depend on the number of threads.
+   *
+   * Decode_error is rethrown in the calling thread, the one of the first
+   * buffer if several buffers fail.
+   *
+   * The threads are started for every call. For small batches that are
+   * decoded over and over again, pass a Worker_pool instead.
+   * */
+  template<typename It, typename Factory>
+  std::vector<detail::Decoder_of<Factory>> batch_decode(It first, It last,
+      Factory make_decoder, std::size_t num_threads = 0) {
+    std::size_t const threads = detail::default_num_threads(num_threads);
+    return detail::batch_decode(first, last, make_decoder,
+        [threads](std::size_t n, auto f) {
+          detail::parallel_for(n, threads, f);
+        });
+  }
+
+  /** Decode many independent programs on the threads of pool, see
+   * batch_decode() above. */
+  template<typename It, typename Factory>
+  std::vector<detail::Decoder_of<Factory>> batch_decode(It first, It last,
+      Factory make_decoder, Worker_pool& pool) {
+    return detail::batch_decode(first, last, make_decoder,
+        [&pool](std::size_t n, auto f) {
+          pool.parallel_for(n, f);
+        });
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
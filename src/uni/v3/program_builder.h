@@ -4,11 +4,55 @@
 #include <uni/v3/instructions.h>
 #include <uni/v3/errors.h>
 
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 
 namespace uni {
 
+  namespace detail {
+
+    /** Size of the largest instruction that Program_builder emits. */
+    constexpr std::size_t max_builder_inst_size() {
+      return std::max({ inst_size(Inst_id::set_time),
+          inst_size(Inst_id::wait_until), inst_size(Inst_id::write),
+          inst_size(Inst_id::wait_for_32), inst_size(Inst_id::wait_for_16),
+          inst_size(Inst_id::wait_for_7), inst_size(Inst_id::read),
+          inst_size(Inst_id::fire_one), inst_size(Inst_id::halt) });
+    }
+
+    /** Check that blocks of block_size can take every instruction of
+     * Program_builder, for allocators with a block size set at runtime.
+     *
+     * @returns block_size
+     * @throws std::invalid_argument if block_size is too small. */
+    inline std::size_t checked_block_size(std::size_t block_size) {
+      if( block_size < max_builder_inst_size() )
+        throw std::invalid_argument("block size "
+            + std::to_string(block_size) + " is smaller than the largest"
+            " instruction of " + std::to_string(max_builder_inst_size())
+            + " bytes");
+      return block_size;
+    }
+
+  }
+
+
+  /** Summary of a block of a program, see Program_builder::manifest(). */
+  struct Block_info {
+    std::size_t offset = 0;         /**< Offset of the block in the program. */
+    Time start_t = 0;               /**< Time before the first instruction. */
+    Time end_t = 0;                 /**< Time after the last instruction. */
+    std::size_t num_instructions = 0;   /**< Instructions without padding. */
+    std::size_t padding = 0;        /**< Bytes after the last instruction. */
+  };
+
+
   /** Build programs out of UNI instructions.
    *
    * @tparam Allocator Object to create buffer blocks.
@@ -27,33 +71,73 @@ namespace uni {
       std::vector<typename Allocator::Container> containers;
 
 
-      Program_builder(Allocator& alloc)
-        : m_alloc(alloc) {
-        containers.push_back(alloc.allocate(Allocator::block_size));
-        m_it = alloc.begin(containers.back());
-        m_stop = alloc.end(containers.back());
+      /** Create a builder with blocks from alloc.
+       *
+       * @param alloc Allocator for the blocks.
+       * @param with_manifest Record a Block_info for every block, see
+       * manifest().
+       * */
+      Program_builder(Allocator& alloc, bool with_manifest = false)
+        : m_alloc(alloc), m_with_manifest(with_manifest) {
+        next_block();
+      }
+
+      /** Create a builder that reuses the memory of a vector of blocks, e.g.
+       * from Block_pool_allocator::take_container_list().
+       *
+       * @param alloc Allocator for the blocks.
+       * @param list Vector to use for containers, its elements are dropped.
+       * @param with_manifest Record a Block_info for every block, see
+       * manifest().
+       * */
+      Program_builder(Allocator& alloc,
+          std::vector<typename Allocator::Container>&& list,
+          bool with_manifest = false)
+        : containers(std::move(list)), m_alloc(alloc),
+          m_with_manifest(with_manifest) {
+        containers.clear();
+        next_block();
+      }
+
+
+      /** Summaries of the blocks built so far.
+       *
+       * Empty unless enabled in the constructor. Blocks start with an
+       * instruction and are padded with WAIT_FOR_7 instructions, except for
+       * the current, last block, whose padding are the bytes not written
+       * yet. The summaries allow to decode blocks in parallel, e.g. with
+       * manifest_split_points(), or to find blocks by time without scanning
+       * the program.
+       * */
+      std::vector<Block_info> manifest() const {
+        std::vector<Block_info> rv(m_manifest);
+        if( m_with_manifest ) {
+          rv.push_back(m_block);
+          rv.back().end_t = m_t;
+          rv.back().padding += std::distance(m_it, m_stop);
+        }
+        return rv;
       }
 
 
       void set_time(Time t) {
-        if( !check_set_time(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::set_time));
 
         m_it = fill_set_time(m_it, t);
+        m_t = t;
       }
 
 
       void wait_until(Time t) {
-        if( !check_wait_until(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::wait_until));
 
         m_it = fill_wait_until(m_it, t);
+        m_t = t;
       }
 
 
       void write(Address addr, Word data) {
-        if( !check_write(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::write));
 
         m_it = fill_write(m_it, addr, data);
       }
@@ -64,34 +148,30 @@ namespace uni {
           throw Encode_error(__func__, "wait_for_*",
               "Delay exceeds wait_for_32. Use wait_until instead.");
         } else if( t > 0xfffful ) {
-          if( !check_wait_for_32(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_32));
 
           m_it = fill_wait_for_32(m_it, t);
         } else if( t > 0x7ful ) {
-          if( !check_wait_for_16(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_16));
 
           m_it = fill_wait_for_16(m_it, t);
         } else {
-          if( !check_wait_for_7(m_it, m_stop) )
-            alloc();
+          reserve(inst_size(Inst_id::wait_for_7));
           m_it = fill_wait_for_7(m_it, t);
         }
+        m_t += t;
       }
 
 
       void read(Address addr) {
-        if( !check_read(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::read));
 
         m_it = fill_read(m_it, addr);
       }
 
 
       void fire_one(uint8_t index, Event_address evaddr) {
-        if( !check_fire_one(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::fire_one));
 
         m_it = fill_fire_one(m_it, index, evaddr);
       }
@@ -137,29 +217,128 @@ namespace uni {
 
 
       void halt() {
-        if( !check_halt(m_it, m_stop) )
-          alloc();
+        reserve(inst_size(Inst_id::halt));
 
         m_it = fill_halt(m_it);
       }
 
 
+      /** Pad the rest of the current block with no-ops.
+       *
+       * Other than full blocks, the last block is not padded by the builder.
+       * Allocators that reuse memory, e.g. Block_pool_allocator, hand out
+       * blocks that still hold parts of earlier programs, which remain in
+       * the last block behind the HALT instruction. Call finish() after the
+       * last instruction to overwrite them, e.g. if the blocks are
+       * transferred as a whole. Further instructions start a new block.
+       * */
+      void finish() {
+        m_block.padding += pad(typename detail::Is_contiguous_bytes<
+            typename Allocator::Iterator>::type());
+        m_remaining = 0;
+      }
+
+
 
 
     protected:
+      /** Allocator::Iterator allows for O(1) capacity checks. */
+      typedef typename detail::Is_random_access<
+        typename Allocator::Iterator>::type Random_access;
+
       Allocator& m_alloc;
       typename Allocator::Iterator m_it, m_stop;
 
+      /** Bytes left in the current block. Only maintained for random-access
+       * iterators, other iterators are checked by walking up to m_stop. */
+      std::size_t m_remaining = 0;
+
+      /** Time after the last instruction, kept for the manifest. */
+      Time m_t = 0;
+
+      bool m_with_manifest = false;
+      std::vector<Block_info> m_manifest;
+
+      /** Summary of the current block, without end_t and the bytes not
+       * written yet. */
+      Block_info m_block;
+
+
+      /** Ensure the current block can take sz more bytes for the next
+       * instruction and account for them. */
+      void reserve(std::size_t sz) {
+        reserve(sz, Random_access());
+        ++m_block.num_instructions;
+      }
+
+      void reserve(std::size_t sz, std::true_type) {
+        if( m_remaining < sz )
+          alloc();
+        m_remaining -= sz;
+      }
+
+      void reserve(std::size_t sz, std::false_type) {
+        if( !check_size(m_it, m_stop, sz) )
+          alloc();
+      }
+
+      void update_remaining(std::true_type) {
+        m_remaining = m_stop - m_it;
+      }
+
+      void update_remaining(std::false_type) {
+      }
+
 
       void alloc() {
-        // fill with no-ops
+        // the block stays full if allocate() throws
+        finish();
+        m_block.end_t = m_t;
+
+        Block_info const done = m_block;
+        next_block();
+        if( m_with_manifest )
+          m_manifest.push_back(done);
+      }
+
+      /** Fill the rest of the block with no-ops, i.e. WAIT_FOR_7 with t = 0,
+       * at once for contiguous blocks.
+       *
+       * @returns Number of filled bytes. */
+      std::size_t pad(std::true_type) {
+        std::size_t const rv = m_stop - m_it;
+        if( rv > 0 ) {
+          std::memset(&*m_it, inst_opcode(Inst_id::wait_for_7), rv);
+          m_it = m_stop;
+        }
+        return rv;
+      }
+
+      std::size_t pad(std::false_type) {
+        std::size_t rv = 0;
         while( m_it != m_stop ) {
           m_it = fill_wait_for_7(m_it, 0);
+          ++rv;
         }
+        return rv;
+      }
 
-        containers.push_back(m_alloc.allocate(Allocator::block_size));
+      void next_block() {
+        // sum of the real sizes, the block size may have changed
+        std::size_t const offset = containers.empty() ? 0 : m_block.offset
+          + std::distance(m_alloc.begin(containers.back()),
+              m_alloc.end(containers.back()));
+
+        // also catches block sizes changed after construction
+        containers.push_back(m_alloc.allocate(
+              detail::checked_block_size(m_alloc.block_size)));
         m_it = m_alloc.begin(containers.back());
         m_stop = m_alloc.end(containers.back());
+        update_remaining(Random_access());
+
+        m_block = Block_info();
+        m_block.offset = offset;
+        m_block.start_t = m_t;
       }
   };
 
@@ -167,9 +346,14 @@ namespace uni {
   /** Simple allocator for use with Program_builder.
    *
    * Creates std::vector<Byte> as buffer block with a maximum size of block_size.
+   * The block size can be chosen at construction, e.g. to match the maximum
+   * transfer size of the transport.
    * */
   struct Byte_vector_allocator {
-    static size_t const block_size = 4096;
+    static size_t const default_block_size = 4096;
+
+    /** Size of the blocks for Program_builder. */
+    size_t block_size = default_block_size;
 
     /** Container type to use by Program_builder. */
     typedef std::vector<Byte> Container;
@@ -178,6 +362,13 @@ namespace uni {
     typedef std::vector<Byte>::iterator Iterator;
 
 
+    /** @throws std::invalid_argument if block_size is smaller than the
+     * largest instruction. */
+    explicit Byte_vector_allocator(size_t block_size = default_block_size)
+      : block_size(detail::checked_block_size(block_size)) {
+    }
+
+
     /** Get Iterator to first byte in Container. */
     Iterator begin(Container& c) {
       return std::begin(c);
@@ -1,8 +1,62 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "uni/v3/instructions.h"
+
 
 namespace uni {
 
+  /** Collects nibbles and packs them into bytes.
+   *
+   * Nibbles are pushed in reverse order, i.e. the last pushed nibble becomes
+   * the high nibble of the first packed byte. The buffer keeps its capacity
+   * across clear(), so once it has grown to the longest sequence no more
+   * memory is allocated. */
+  class Nibble_packer {
+    public:
+      void push(uint8_t nibble) {
+        m_nibbles.push_back(nibble);
+      }
+
+      /** Push the low and then the high nibble of b. */
+      void push_byte(Byte b) {
+        m_nibbles.push_back(b & 0xf);
+        m_nibbles.push_back((b >> 4) & 0xf);
+      }
+
+      std::size_t size() const {
+        return m_nibbles.size();
+      }
+
+      bool empty() const {
+        return m_nibbles.empty();
+      }
+
+      void clear() {
+        m_nibbles.clear();
+      }
+
+      /** Store the collected nibbles two per byte in data. An odd nibble
+       * count leaves the low nibble of the last byte zero. */
+      void pack(std::vector<Byte>& data) const {
+        std::size_t const n = m_nibbles.size();
+        data.resize((n + 1) / 2);
+
+        uint8_t const* p = m_nibbles.data() + n;
+        for(std::size_t i=0; i<n/2; ++i, p -= 2)
+          data[i] = (p[-1] << 4) | p[-2];
+        if( n & 1 )
+          data[n/2] = p[-1] << 4;
+      }
+
+    private:
+      std::vector<uint8_t> m_nibbles;
+  };
+
+
   /** Extract RAW instructions from byte-code.
    *
    * Use together with decode().
@@ -11,14 +65,21 @@ namespace uni {
    * set. The valid bit is checked within each byte of the instructions data
    * part. */
   struct Raw_extract_decoder {
+    static bool const raw_view = true;
+    typedef Inst_set<Raw_inst> handled_instructions;
+
     /** Indicate bit position of the valid bit (from the right). */
     static const size_t valid_loopback_idx = 2;
 
+    /** Valid bits of both nibbles in eight bytes. */
+    static const uint64_t valid_bits = 0x0101010101010101ull
+      * ((1u << valid_loopback_idx) | (1u << (valid_loopback_idx + 4)));
+
     /** Extracted Raw_inst. */
     std::vector<Raw_inst> extracted;
 
     /** Temporary variable for extracted nibbles. */
-    std::deque<uint8_t> nibbles;
+    Nibble_packer nibbles;
 
 
     template<typename T> void operator () (T const& /*inst*/) {
@@ -26,39 +87,58 @@ namespace uni {
 
     /** Append a new Raw_inst from currently collected nibbles. */
     void append() {
-      Raw_inst e;
-
-      size_t i;
-      for(i=0; i<nibbles.size(); i += 2) {
-        uint8_t tmp = nibbles[i] << 4;
-        if( i+1 < nibbles.size() )
-          tmp |= nibbles[i+1];
-        e.data.push_back(tmp);
-      }
-
-      extracted.push_back(e);
+      extracted.emplace_back();
+      nibbles.pack(extracted.back().data);
       nibbles.clear();
     }
 
-    void operator () (Raw_inst const& inst) {
-      for(size_t i=0; i<inst.data.size(); ++i) {
-        auto idx = inst.data.size() - i - 1;
+    void operator () (Raw_view const& inst) {
+      size_t idx = inst.size;
+
+      while( idx > 0 ) {
+        // Test the valid bits of eight bytes at once. The high nibble of the
+        // first byte is never extracted, so it is left to the scalar path.
+        if( idx > 8 ) {
+          uint64_t w;
+          std::memcpy(&w, inst.data + idx - 8, sizeof(w));
+          uint64_t const valid = w & valid_bits;
+
+          if( valid == valid_bits ) {
+            for(size_t k=1; k<=8; ++k)
+              nibbles.push_byte(inst.data[idx - k]);
+            idx -= 8;
+            continue;
+          }
+
+          if( valid == 0 ) {
+            if( !nibbles.empty() )
+              append();
+            idx -= 8;
+            continue;
+          }
+        }
 
-        if( inst.data[idx] & (1 << valid_loopback_idx) )
-          nibbles.push_front(inst.data[idx] & 0xf);
+        --idx;
+        Byte const b = inst.data[idx];
+
+        if( b & (1 << valid_loopback_idx) )
+          nibbles.push(b & 0xf);
         else if( !nibbles.empty() )
           append();
 
         if( idx != 0 ) {
-          if( inst.data[idx] & (1 << (valid_loopback_idx + 4)) )
-            nibbles.push_front((inst.data[idx] >> 4) & 0xf);
+          if( b & (1 << (valid_loopback_idx + 4)) )
+            nibbles.push((b >> 4) & 0xf);
           else if( !nibbles.empty() )
             append();
         }
-
       }
     }
 
+    void operator () (Raw_inst const& inst) {
+      (*this)(Raw_view(inst));
+    }
+
   };
 
 }
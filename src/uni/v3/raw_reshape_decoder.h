@@ -13,24 +13,35 @@ namespace uni {
   struct Raw_reshape_decoder : public Raw_extract_decoder {
     size_t num_nibbles = 33;
 
-    template<typename T> void operator () (T const& inst) {
+    template<typename T> void operator () (T const& /*inst*/) {
     }
 
-    void operator () (Raw_inst const& inst) {
-      for(size_t i=0; i<inst.data.size(); ++i) {
-        auto idx = inst.data.size() - i - 1;
+    void operator () (Raw_view const& inst) {
+      size_t idx = inst.size;
+
+      while( idx > 0 ) {
+        // whole bytes while the frame cannot be completed by them
+        while( (idx > 1) && (nibbles.size() + 2 < num_nibbles) ) {
+          --idx;
+          nibbles.push_byte(inst.data[idx]);
+        }
 
-        nibbles.push_front(inst.data[idx] & 0xf);
+        --idx;
+        nibbles.push(inst.data[idx] & 0xf);
         if( nibbles.size() >= num_nibbles )
           append();
 
         if( idx != 0 ) {
-          nibbles.push_front((inst.data[idx] >> 4) & 0xf);
+          nibbles.push((inst.data[idx] >> 4) & 0xf);
           if( nibbles.size() >= num_nibbles )
             append();
         }
       }
     }
+
+    void operator () (Raw_inst const& inst) {
+      (*this)(Raw_view(inst));
+    }
   };
 
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <vector>
+
+#include "uni/v3/instructions.h"
+
 
 namespace uni {
 
@@ -10,6 +14,8 @@ namespace uni {
    * Only read and write instructions are considered and collected in the
    * extracted vector. */
   struct Rw_extract_decoder {
+    typedef Inst_set<Read_inst, Write_inst> handled_instructions;
+
     /** Type for result collection */
     struct Entry {
       bool is_write;      /**< Entry is a write operation. */
@@ -41,5 +47,45 @@ namespace uni {
     }
   };
 
+
+  /** Register access extracted by Compact_rw_extract_decoder. */
+  struct Rw_access {
+    Address address;    /**< Accessed address. */
+    Word data;          /**< Written data, 0 for reads. */
+    bool is_write;      /**< Entry is a write operation. */
+
+    bool operator == (Rw_access const& other) const {
+      return (address == other.address) && (data == other.data)
+        && (is_write == other.is_write);
+    }
+  };
+
+  static_assert(sizeof(Rw_access) <= 12, "Rw_access is supposed to be compact");
+
+
+  /** Decode READ and WRITE instructions from byte-code into compact
+   * records.
+   *
+   * Same as Rw_extract_decoder, but every access is stored as a 12 byte
+   * Rw_access instead of an Entry holding both instructions. */
+  struct Compact_rw_extract_decoder {
+    typedef Inst_set<Read_inst, Write_inst> handled_instructions;
+
+    /** Array of extracted accesses. */
+    std::vector<Rw_access> extracted;
+
+
+    template<typename T> void operator () (T const& /*inst*/) {
+    }
+
+    void operator () (Read_inst const& inst) {
+      extracted.push_back(Rw_access{inst.address, 0, false});
+    }
+
+    void operator () (Write_inst const& inst) {
+      extracted.push_back(Rw_access{inst.address, inst.data, true});
+    }
+  };
+
 }
 
@@ -1,12 +1,85 @@
 #pragma once
 
 #include <uni/v3/types.h>
+#include <uni/v3/instructions.h>
+#include <uni/v3/decoder.h>
+#include <uni/v3/madc_unpack.h>
 #include <uni/v3/standard_address_map.h>
+#include <algorithm>
+#include <cstddef>
 #include <vector>
 
 
 namespace uni {
 
+  /** Track the current time from timing instructions.
+   *
+   * Base for decoders that need the time of other instructions. Derived
+   * decoders bring the operators into scope with
+   *
+   *   using Time_tracking_decoder::operator ();
+   *
+   * Runs of WAIT_FOR_7 instructions are accumulated by decode() and passed
+   * as a single Wait_for_7_run.
+   * */
+  struct Time_tracking_decoder {
+    static bool const wait_for_7_runs = true;
+
+    Time cur_t = 0;                 /**< Current time during decoding. */
+
+    void operator () (Set_time_inst const& inst) {
+      cur_t = inst.t;
+    }
+
+    void operator () (Wait_until_inst const& inst) {
+      cur_t = inst.t;
+    }
+
+    void operator () (Wait_for_7_inst const& inst) {
+      cur_t += inst.t;
+    }
+
+    void operator () (Wait_for_7_run const& inst) {
+      cur_t += inst.t;
+    }
+
+    void operator () (Wait_for_16_inst const& inst) {
+      cur_t += inst.t;
+    }
+
+    void operator () (Wait_for_32_inst const& inst) {
+      cur_t += inst.t;
+    }
+  };
+
+
+  /** Translate a FIRE_ONE instruction into a spike or MADC samples.
+   *
+   * Calls spike(evaddr) for a spike and sample(value) for each of the up to
+   * three MADC samples. */
+  template<typename Spike_fn, typename Sample_fn>
+  void unpack_fire_one_or_madc(Fire_one_or_madc_inst const& inst,
+      Spike_fn spike, Sample_fn sample) {
+    unsigned int sample_0 = inst.payload & 0x3FF;
+    unsigned int sample_1 = (inst.payload >> 10) & 0x3FF;
+    unsigned int sample_2 = (inst.payload >> 20) & 0x3FF;
+    Event_address evaddr = (~inst.payload & 0xFF);
+    switch(inst.key) {
+      case 0: spike(evaddr);
+              break;
+      case 1: sample(sample_0);
+              break;
+      case 2: sample(sample_0);
+              sample(sample_1);
+              break;
+      case 3: sample(sample_0);
+              sample(sample_1);
+              sample(sample_2);
+              break;
+    }
+  }
+
+
   /** Decode a spiketrain from byte-code.
    *
    * @tparam Map Address map to translate between index and evaddr and Spike
@@ -22,58 +95,178 @@ namespace uni {
    * as Map.
    * */
   template<typename Map>
-  struct Spiketrain_and_madc_decoder {
-    Time cur_t = 0;                 /**< Current time during decoding. */
+  struct Spiketrain_and_madc_decoder : Time_tracking_decoder {
+    typedef Inst_set<Set_time_inst, Wait_until_inst, Wait_for_7_inst,
+            Wait_for_16_inst, Wait_for_32_inst, Fire_one_or_madc_inst>
+      handled_instructions;
+
     std::vector<Spike> extracted_spikes;   /**< Result spikes after decode(). */
     std::vector<MADCSample> extracted_samples;   /**< Result samples after decode(). */
     Map addr_map;                   /**< Address map for address translation. */
 
+    using Time_tracking_decoder::operator ();
+
     template<typename T> void operator () (T const& /*inst*/) {
     }
 
-    void operator () (Set_time_inst const& inst) {
-      cur_t = inst.t;
+    void operator () (Fire_one_or_madc_inst const& inst) {
+      unpack_fire_one_or_madc(inst,
+          [this](Event_address evaddr) {
+            extracted_spikes.emplace_back(cur_t, evaddr);
+          },
+          [this](uint16_t value) {
+            extracted_samples.emplace_back(cur_t, value);
+          });
     }
+  };
 
-    void operator () (Wait_until_inst const& inst) {
-      cur_t = inst.t;
-    }
 
-    void operator () (Wait_for_7_inst const& inst) {
-      cur_t += inst.t;
+  typedef Spiketrain_and_madc_decoder<Standard_address_map> Standard_spiketrain_and_madc_decoder;
+
+
+  /** Number of spikes and MADC samples in byte-code, see
+   * count_spikes_and_samples(). */
+  struct Spike_and_sample_count {
+    std::size_t spikes = 0;
+    std::size_t samples = 0;
+  };
+
+
+  namespace detail {
+
+    struct Spike_and_sample_count_decoder {
+      typedef Inst_set<Fire_one_or_madc_inst> handled_instructions;
+
+      Spike_and_sample_count count;
+
+      template<typename T> void operator () (T const& /*inst*/) {
+      }
+
+      void operator () (Fire_one_or_madc_inst const& inst) {
+        if( inst.key == 0 )
+          ++count.spikes;
+        else
+          count.samples += inst.key;
+      }
+    };
+
+  }
+
+
+  /** Count the spikes and MADC samples in [a, b).
+   *
+   * Only FIRE_ONE instructions are decoded, all others are skipped. Use to
+   * reserve the output of Columnar_spiketrain_and_madc_decoder. */
+  template<typename It>
+  Spike_and_sample_count count_spikes_and_samples(It a, It b) {
+    detail::Spike_and_sample_count_decoder dec;
+    decode(a, b, dec);
+    return dec.count;
+  }
+
+
+  /** Decode a spiketrain from byte-code into columns.
+   *
+   * Same as Spiketrain_and_madc_decoder, but spikes and MADC samples are
+   * stored as separate columns for time, address and value instead of
+   * arrays of Spike and MADCSample. Use reserve() with a capacity hint or
+   * the result of count_spikes_and_samples() to allocate the columns once:
+   * @code
+   * uni::Standard_columnar_spiketrain_and_madc_decoder dec;
+   * dec.reserve(uni::count_spikes_and_samples(buf.begin(), buf.end()));
+   * uni::decode(buf.begin(), buf.end(), dec);
+   * @endcode
+   *
+   * Runs of FIRE_ONE instructions in contiguous buffers are unpacked in
+   * blocks with unpack_madc().
+   * */
+  template<typename Map>
+  struct Columnar_spiketrain_and_madc_decoder : Time_tracking_decoder {
+    typedef Inst_set<Set_time_inst, Wait_until_inst, Wait_for_7_inst,
+            Wait_for_16_inst, Wait_for_32_inst, Fire_one_or_madc_inst>
+      handled_instructions;
+
+    static bool const fire_one_runs = true;
+
+    struct Spike_columns {
+      std::vector<Time> time;
+      std::vector<Event_address> address;
+
+      std::size_t size() const {
+        return time.size();
+      }
+    };
+
+    struct Sample_columns {
+      std::vector<Time> time;
+      std::vector<uint16_t> value;
+
+      std::size_t size() const {
+        return time.size();
+      }
+    };
+
+    Spike_columns spikes;           /**< Result spikes after decode(). */
+    Sample_columns samples;         /**< Result samples after decode(). */
+    Map addr_map;                   /**< Address map for address translation. */
+
+    using Time_tracking_decoder::operator ();
+
+    /** Reserve the columns for the given number of spikes and samples. */
+    void reserve(std::size_t num_spikes, std::size_t num_samples) {
+      spikes.time.reserve(num_spikes);
+      spikes.address.reserve(num_spikes);
+      samples.time.reserve(num_samples);
+      samples.value.reserve(num_samples);
     }
 
-    void operator () (Wait_for_16_inst const& inst) {
-      cur_t += inst.t;
+    void reserve(Spike_and_sample_count const& count) {
+      reserve(count.spikes, count.samples);
     }
 
-    void operator () (Wait_for_32_inst const& inst) {
-      cur_t += inst.t;
+    template<typename T> void operator () (T const& /*inst*/) {
     }
 
     void operator () (Fire_one_or_madc_inst const& inst) {
-      unsigned int sample_0 = inst.payload & 0x3FF;
-      unsigned int sample_1 = (inst.payload >> 10) & 0x3FF;
-      unsigned int sample_2 = (inst.payload >> 20) & 0x3FF;
-      Event_address evaddr = (~inst.payload & 0xFF);
-      switch(inst.key) {
-        case 0: extracted_spikes.emplace_back(cur_t, evaddr);
-                break;
-        case 1: extracted_samples.emplace_back(cur_t, sample_0);
-                break;
-        case 2: extracted_samples.emplace_back(cur_t, sample_0);
-                extracted_samples.emplace_back(cur_t, sample_1);
-                break;
-        case 3: extracted_samples.emplace_back(cur_t, sample_0);
-                extracted_samples.emplace_back(cur_t, sample_1);
-                extracted_samples.emplace_back(cur_t, sample_2);
-                break;
+      unpack_fire_one_or_madc(inst,
+          [this](Event_address evaddr) {
+            spikes.time.push_back(cur_t);
+            spikes.address.push_back(evaddr);
+          },
+          [this](uint16_t value) {
+            samples.time.push_back(cur_t);
+            samples.value.push_back(value);
+          });
+    }
+
+    void operator () (Fire_one_run const& run) {
+      // unpack through a buffer on the stack, so the columns only grow by
+      // the actual number of samples and keep a reserved capacity
+      std::size_t const chunk = 64;
+      uint16_t buf[3 * chunk + 1];
+
+      Fire_one_run part = run;
+      while( part.size > 0 ) {
+        Fire_one_run head = part;
+        head.size = std::min(part.size, chunk);
+
+        uint16_t* const end = unpack_madc(head, buf,
+            [this](Event_address evaddr) {
+              spikes.time.push_back(cur_t);
+              spikes.address.push_back(evaddr);
+            });
+        samples.value.insert(samples.value.end(), buf, end);
+        samples.time.insert(samples.time.end(), end - buf, cur_t);
+
+        part.data += head.size * inst_size(Inst_id::fire_one);
+        part.size -= head.size;
       }
     }
   };
 
 
-  typedef Spiketrain_and_madc_decoder<Standard_address_map> Standard_spiketrain_and_madc_decoder;
+  typedef Columnar_spiketrain_and_madc_decoder<Standard_address_map>
+    Standard_columnar_spiketrain_and_madc_decoder;
 
 }
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+#include "uni/v3/instructions.h"
+#include "uni/v3/decoder.h"
+
+
+namespace uni {
+
+  /** Decode byte-code that arrives in chunks of arbitrary size.
+   *
+   * @tparam Decoder Type to use for decoding of byte-code.
+   *
+   * Use feed() for every chunk received from the transport. Each chunk is
+   * decoded in place, like with decode(). An instruction that is cut off by
+   * the end of a chunk is kept in the context and completed with the bytes
+   * of the next chunk, so only the bytes of such an instruction are ever
+   * copied.
+   *
+   * The decoder is held by reference, so its state, e.g. the current time
+   * of Spiketrain_and_madc_decoder, carries over from chunk to chunk.
+   * Raw_view instructions passed to the decoder may point into the context
+   * and are only valid during the call.
+   *
+   * Typical usage:
+   * @code
+   * uni::Standard_spiketrain_and_madc_decoder dec;
+   * uni::Stream_decode_context<decltype(dec)> ctx(dec);
+   * while( transport.receive(buf) )
+   *   ctx.feed(buf.begin(), buf.end());
+   * @endcode
+   * */
+  template<typename Decoder>
+  class Stream_decode_context {
+    public:
+      /** Maximum length of an instruction in bytes (RAW with 255 bytes). */
+      static std::size_t const max_inst_size = 2 + 255;
+
+
+      explicit Stream_decode_context(Decoder& dec)
+        : m_dec(dec) {
+      }
+
+
+      /** Decode the next chunk of byte-code.
+       *
+       * @param a Beginning of the chunk.
+       * @param b Past the end of the chunk.
+       * @returns Number of bytes of the chunk that were consumed. This is
+       * the whole chunk unless a HALT instruction ends the program in it.
+       * */
+      std::size_t feed(Byte const* a, Byte const* b) {
+        if( m_halted )
+          return 0;
+
+        Byte const* p = a;
+
+        if( m_partial_size > 0 ) {
+          p = complete_partial(p, b);
+          if( (m_partial_size > 0) || m_halted )
+            return p - a;
+        }
+
+        Byte const* const stop = detail::decode_loop<true>(p, b, m_dec,
+            m_halted);
+        if( m_halted )
+          return stop - a;
+
+        // keep the cut off instruction for the next chunk
+        m_partial_size = b - stop;
+        std::copy(stop, b, m_partial);
+        return b - a;
+      }
+
+
+      /** Decode the next chunk from a std::vector<Byte> or other contiguous
+       * buffer, see feed(Byte const*, Byte const*). */
+      template<typename It>
+      typename std::enable_if<detail::Is_contiguous_bytes<It>::value,
+               std::size_t>::type
+      feed(It a, It b) {
+        if( a == b )
+          return 0;
+        return feed(static_cast<Byte const*>(&*a), &*a + (b - a));
+      }
+
+
+      /** A HALT instruction was decoded, further chunks are ignored. */
+      bool halted() const {
+        return m_halted;
+      }
+
+      /** Number of bytes of an incomplete instruction kept for the next
+       * chunk. */
+      std::size_t pending() const {
+        return m_partial_size;
+      }
+
+
+    private:
+      Decoder& m_dec;
+      Byte m_partial[max_inst_size];
+      std::size_t m_partial_size = 0;
+      bool m_halted = false;
+
+
+      /** Length of the kept instruction as far as it is known. */
+      std::size_t partial_length() const {
+        std::size_t const len = opcode_info(m_partial[0]).size;
+        if( len != Opcode_info::variable_size )
+          return len;
+
+        if( m_partial_size < inst_size(Inst_id::raw) )
+          return inst_size(Inst_id::raw);
+        return inst_size(Inst_id::raw) + m_partial[1];
+      }
+
+
+      /** Complete the kept instruction from [p, b) and decode it. */
+      Byte const* complete_partial(Byte const* p, Byte const* b) {
+        std::size_t len;
+        while( (len = partial_length()) > m_partial_size ) {
+          if( p == b )
+            return p;
+
+          std::size_t const n = std::min<std::size_t>(len - m_partial_size,
+              b - p);
+          std::copy(p, p + n, m_partial + m_partial_size);
+          m_partial_size += n;
+          p += n;
+        }
+
+        Byte const* const partial = m_partial;
+        detail::decode_loop<true>(partial, partial + m_partial_size, m_dec,
+            m_halted);
+        m_partial_size = 0;
+        return p;
+      }
+  };
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "uni/v3/instructions.h"
+#include "uni/v3/errors.h"
+#include "uni/v3/decoder.h"
+#include "uni/v3/time_scan.h"
+#include "uni/v3/wait_for_7_scan.h"
+
+
+namespace uni {
+
+  /** Checkpoints of the absolute time in a program, see build_time_index().
+   *
+   * The first checkpoint is the start of the program at time 0. The index
+   * is only useful for programs where the time does not decrease, e.g.
+   * recordings.
+   * */
+  struct Time_index {
+    std::vector<Split_point> checkpoints;   /**< Checkpoints by offset. */
+
+    /** Index of the checkpoint to start decoding from to find all
+     * instructions at time t or later, i.e. the last one before t. */
+    std::size_t seek(Time t) const {
+      auto const it = std::lower_bound(checkpoints.begin(), checkpoints.end(),
+          t, [](Split_point const& c, Time t) { return c.t < t; });
+      if( it == checkpoints.begin() )
+        return 0;
+      return (it - checkpoints.begin()) - 1;
+    }
+  };
+
+
+  /** Record the time every few bytes or instructions of a program.
+   *
+   * @param a Beginning of byte-code, has to be the start of an instruction.
+   * @param b Past the end of byte-code.
+   * @param bytes Record a checkpoint after at least this many bytes, 0 to
+   * only count instructions.
+   * @param instructions Record a checkpoint after at least this many
+   * instructions, 0 to only count bytes.
+   * @returns Index with a checkpoint at the start of the program and
+   * whenever one of the limits is reached, up to a HALT instruction or an
+   * instruction that is cut off by b.
+   *
+   * Walks the program by instruction lengths like summarize_time(). Every
+   * WAIT_FOR_7 instruction counts as an instruction, so checkpoints can be
+   * inside of runs of them.
+   * */
+  inline Time_index build_time_index(Byte const* a, Byte const* b,
+      std::size_t bytes, std::size_t instructions = 0) {
+    std::size_t const no_limit = std::numeric_limits<std::size_t>::max();
+    if( bytes == 0 )
+      bytes = no_limit;
+    if( instructions == 0 )
+      instructions = no_limit;
+
+    Time_index rv;
+    rv.checkpoints.emplace_back(0, 0);
+
+    Time_summary sum;
+    Byte const* p = a;
+    Byte const* last = a;
+    std::size_t count = 0;
+
+    while( p != b ) {
+      std::size_t const since = p - last;
+      if( (since >= bytes) || (count >= instructions) ) {
+        rv.checkpoints.emplace_back(p - a, sum.t);
+        last = p;
+        count = 0;
+      }
+
+      if( *p & 0x80 ) {
+        std::size_t const n = std::min({ static_cast<std::size_t>(b - p),
+            bytes - static_cast<std::size_t>(p - last), instructions - count });
+        Byte const* const q = detail::scan_wait_for_7(p, p + n, sum.t);
+        count += q - p;
+        p = q;
+        continue;
+      }
+
+      std::size_t const len = detail::inst_length(p, b - p);
+      if( len == 0 ) {
+        if( !opcode_info(*p).valid )
+          throw Decode_error(__func__, "unknown", *p,
+              "encountered unknown opcode");
+        break;
+      }
+
+      Byte const op = *p;
+      detail::apply_time(p, sum);
+      p += len;
+      ++count;
+      if( op == inst_opcode(Inst_id::halt) )
+        break;
+    }
+
+    return rv;
+  }
+
+
+  /** Decode the part of a program around a time window.
+   *
+   * @param a Beginning of byte-code.
+   * @param b Past the end of byte-code.
+   * @param index Index of the program from build_time_index().
+   * @param begin Start of the time window.
+   * @param end End of the time window.
+   * @param dec Decoder object to collect results.
+   * @returns Past the end of the last decoded instruction.
+   *
+   * Decoding starts at the last checkpoint before begin and stops at the
+   * first checkpoint at or after end, so dec receives all instructions at
+   * times in [begin, end) and up to one checkpoint interval of instructions
+   * before and after the window. Unless decoding starts at the beginning
+   * of the program, dec first receives a Set_time_inst with the time of the
+   * checkpoint, so time tracking decoders produce the same times as
+   * decode() from the start.
+   * */
+  template<typename Decoder>
+  Byte const* decode_window(Byte const* a, Byte const* b,
+      Time_index const& index, Time begin, Time end, Decoder& dec) {
+    std::vector<Split_point> const& cps = index.checkpoints;
+    std::size_t i = index.seek(begin);
+
+    if( cps[i].offset > 0 ) {
+      Set_time_inst start;
+      start.t = cps[i].t;
+      dec(start);
+    }
+
+    Byte const* p = a + cps[i].offset;
+    for(; (i < cps.size()) && (cps[i].t < end); ++i) {
+      Byte const* const q = (i + 1 < cps.size()) ? a + cps[i + 1].offset : b;
+      p = decode(p, q, dec);
+      if( p != q )
+        break;
+    }
+    return p;
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
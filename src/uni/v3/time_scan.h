@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "uni/v3/instructions.h"
+#include "uni/v3/errors.h"
+#include "uni/v3/decoder.h"
+#include "uni/v3/wait_for_7_scan.h"
+
+
+namespace uni {
+
+  /** Effect of a sequence of instructions on the time, see
+   * summarize_time(). */
+  struct Time_summary {
+    /** The sequence contains SET_TIME or WAIT_UNTIL, so t is absolute. */
+    bool absolute = false;
+
+    /** Time at the end of the sequence, absolute or relative to its
+     * start. */
+    Time t = 0;
+
+    /** Offset past the last complete instruction. */
+    std::size_t end = 0;
+
+    /** The sequence ends with a HALT instruction. */
+    bool halted = false;
+
+
+    /** Time at the end of the sequence if it starts at start. */
+    Time apply(Time start) const {
+      return absolute ? t : start + t;
+    }
+  };
+
+
+  /** Offset of an instruction in a program and the time before it, e.g.
+   * the start of a piece for parallel_decode() or a checkpoint of a
+   * Time_index. */
+  struct Split_point {
+    std::size_t offset = 0;         /**< Offset of the instruction. */
+    Time t = 0;                     /**< Time at offset. */
+
+    Split_point() {
+    }
+
+    Split_point(std::size_t offset, Time t)
+      : offset(offset), t(t) {
+    }
+  };
+
+
+  namespace detail {
+
+    /** Apply the instruction at p to the time of the summary. */
+    inline void apply_time(Byte const* p, Time_summary& rv) {
+      switch( opcode_info(*p).id ) {
+        case Inst_id::set_time:
+        case Inst_id::wait_until:
+          uni::read_data(p + 1, rv.t);
+          rv.absolute = true;
+          break;
+
+        case Inst_id::wait_for_16: {
+          uint16_t t;
+          uni::read_data(p + 1, t);
+          rv.t += t;
+          break;
+        }
+
+        case Inst_id::wait_for_32: {
+          uint32_t t;
+          uni::read_data(p + 1, t);
+          rv.t += t;
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+
+  }
+
+
+  /** Compute the effect of the instructions in [a, b) on the time.
+   *
+   * @param a Beginning of byte-code, has to be the start of an instruction.
+   * @param b Past the end of byte-code.
+   * @returns Summary of the time up to a HALT instruction or an instruction
+   * that is cut off by b.
+   *
+   * Walks the buffer by instruction lengths and only reads the arguments of
+   * timing instructions. Summaries of consecutive pieces of a program can be
+   * combined with Time_summary::apply(), e.g. to compute the time at the
+   * pieces' boundaries in parallel.
+   * */
+  inline Time_summary summarize_time(Byte const* a, Byte const* b) {
+    Time_summary rv;
+    Byte const* p = a;
+
+    while( p != b ) {
+      if( *p & 0x80 ) {
+        p = detail::scan_wait_for_7(p, b, rv.t);
+        continue;
+      }
+
+      std::size_t const len = detail::inst_length(p, b - p);
+      if( len == 0 ) {
+        if( !opcode_info(*p).valid )
+          throw Decode_error(__func__, "unknown", *p,
+              "encountered unknown opcode");
+        break;
+      }
+
+      Byte const op = *p;
+      detail::apply_time(p, rv);
+      p += len;
+      if( op == inst_opcode(Inst_id::halt) ) {
+        rv.halted = true;
+        break;
+      }
+    }
+
+    rv.end = p - a;
+    return rv;
+  }
+
+
+  /** Duration and instruction counts of a program, see
+   * summarize_program(). */
+  struct Program_summary {
+    /** Time at the end of the program, starting at 0. */
+    Time t = 0;
+
+    /** Time spent waiting, i.e. the run time of the program. SET_TIME does
+     * not count and WAIT_UNTIL only counts if it lies ahead. */
+    Time duration = 0;
+
+    /** Offset past the last complete instruction. */
+    std::size_t end = 0;
+
+    /** The program ends with a HALT instruction. */
+    bool halted = false;
+
+    /** Number of instructions by Inst_id. */
+    std::array<std::size_t, num_inst_ids> counts{};
+
+
+    std::size_t count(Inst_id id) const {
+      return counts[static_cast<std::size_t>(id)];
+    }
+
+    /** Total number of instructions. */
+    std::size_t num_instructions() const {
+      std::size_t rv = 0;
+      for(auto c : counts)
+        rv += c;
+      return rv;
+    }
+  };
+
+
+  /** Compute the duration and instruction counts of a program.
+   *
+   * @param a Beginning of byte-code, has to be the start of an instruction.
+   * @param b Past the end of byte-code.
+   * @returns Summary up to a HALT instruction or an instruction that is cut
+   * off by b.
+   *
+   * Like summarize_time(), walks the buffer by instruction lengths without
+   * decoding into Instruction objects. Runs of WAIT_FOR_7 instructions are
+   * summed with SIMD instructions where available.
+   * */
+  inline Program_summary summarize_program(Byte const* a, Byte const* b) {
+    Program_summary rv;
+    Byte const* p = a;
+
+    while( p != b ) {
+      if( *p & 0x80 ) {
+        Time t = 0;
+        Byte const* const q = detail::scan_wait_for_7(p, b, t);
+        rv.counts[static_cast<std::size_t>(Inst_id::wait_for_7)] += q - p;
+        rv.t += t;
+        rv.duration += t;
+        p = q;
+        continue;
+      }
+
+      std::size_t const len = detail::inst_length(p, b - p);
+      if( len == 0 ) {
+        if( !opcode_info(*p).valid )
+          throw Decode_error(__func__, "unknown", *p,
+              "encountered unknown opcode");
+        break;
+      }
+
+      Inst_id const id = opcode_info(*p).id;
+      ++rv.counts[static_cast<std::size_t>(id)];
+
+      Time t = rv.t;
+      Time_summary time;
+      detail::apply_time(p, time);
+      if( time.absolute ) {
+        t = time.t;
+        if( (id == Inst_id::wait_until) && (t > rv.t) )
+          rv.duration += t - rv.t;
+      } else {
+        t += time.t;
+        rv.duration += time.t;
+      }
+      rv.t = t;
+
+      p += len;
+      if( id == Inst_id::halt ) {
+        rv.halted = true;
+        break;
+      }
+    }
+
+    rv.end = p - a;
+    return rv;
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */
@@ -4,6 +4,8 @@
 #include <uni/v3/bytewise_output_iterator.h>
 #include <uni/v3/byte_printer.h>
 #include <uni/v3/decoder.h>
+#include <uni/v3/fan_out_decoder.h>
 #include <uni/v3/program_builder.h>
 #include <uni/v3/standard_address_map.h>
+#include <uni/v3/stream_decode_context.h>
 
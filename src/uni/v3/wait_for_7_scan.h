@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "uni/v3/types.h"
+
+
+namespace uni {
+
+  namespace detail {
+
+    /** Sum of the low seven bits of the eight bytes in w. */
+    inline unsigned sum_low_7(uint64_t w) {
+      uint64_t const x = w & 0x7f7f7f7f7f7f7f7full;
+      uint64_t const pairs = (x & 0x00ff00ff00ff00ffull)
+        + ((x >> 8) & 0x00ff00ff00ff00ffull);
+      return (pairs * 0x0001000100010001ull) >> 48;
+    }
+
+
+#if defined(__AVX2__)
+    static std::size_t const wait_for_7_block_size = 32;
+
+    /** Add the times of a block of bytes to t if they all have the MSB set.
+     *
+     * @returns false without changing t otherwise. */
+    inline bool scan_wait_for_7_block(Byte const* p, Time& t) {
+      __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+      if( _mm256_movemask_epi8(v) != -1 )
+        return false;
+
+      __m256i const sums = _mm256_sad_epu8(
+          _mm256_and_si256(v, _mm256_set1_epi8(0x7f)), _mm256_setzero_si256());
+      __m128i const s = _mm_add_epi64(_mm256_castsi256_si128(sums),
+          _mm256_extracti128_si256(sums, 1));
+      t += _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4);
+      return true;
+    }
+#elif defined(__SSE2__)
+    static std::size_t const wait_for_7_block_size = 16;
+
+    inline bool scan_wait_for_7_block(Byte const* p, Time& t) {
+      __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+      if( _mm_movemask_epi8(v) != 0xffff )
+        return false;
+
+      __m128i const s = _mm_sad_epu8(_mm_and_si128(v, _mm_set1_epi8(0x7f)),
+          _mm_setzero_si128());
+      t += _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4);
+      return true;
+    }
+#else
+    static std::size_t const wait_for_7_block_size = 8;
+
+    inline bool scan_wait_for_7_block(Byte const* p, Time& t) {
+      uint64_t w;
+      std::memcpy(&w, p, sizeof(w));
+      if( (w & 0x8080808080808080ull) != 0x8080808080808080ull )
+        return false;
+
+      t += sum_low_7(w);
+      return true;
+    }
+#endif
+
+
+    /** Find the end of the run of WAIT_FOR_7 instructions, i.e. bytes with
+     * the MSB set, that starts at a and add their times to t. */
+    inline Byte const* scan_wait_for_7(Byte const* a, Byte const* b, Time& t) {
+      std::size_t const block = wait_for_7_block_size;
+      Byte const* p = a;
+
+      while( (static_cast<std::size_t>(b - p) >= block)
+          && scan_wait_for_7_block(p, t) )
+        p += block;
+
+      while( (p != b) && (*p & 0x80) ) {
+        t += *p & 0x7f;
+        ++p;
+      }
+      return p;
+    }
+
+  }
+
+}
+
+/* vim: set et fenc= ff=unix sts=0 sw=2 ts=2 : */